@@ -0,0 +1,250 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+
+#ifndef OPS_FILE_APPLYPOOL_CXX
+
+
+#include "OpsHeader.hxx"
+#include "ApplyPool.hxx"
+
+
+namespace Ops
+{
+
+
+  //! Main constructor.
+  /*! The Lua states are loaded, and the worker threads are started.
+    \param[in] snapshot the configuration, as returned by 'Ops::Serialize'.
+    \param[in] worker_count number of worker threads and Lua states.
+    \param[in] queue_capacity maximum number of queued calls.
+    \param[in] executor runs the completions (e.g., by posting them to an
+    event loop). If it is empty, the completions are run in the worker
+    threads.
+  */
+  ApplyPool::ApplyPool(const std::string& snapshot, int worker_count,
+                       std::size_t queue_capacity, Executor executor):
+    queue_capacity_(queue_capacity), executor_(executor), stop_(false)
+  {
+    if (worker_count <= 0)
+      throw Error("ApplyPool::ApplyPool", "The number of workers must be "
+                  "positive.");
+    if (queue_capacity == 0)
+      throw Error("ApplyPool::ApplyPool", "The capacity of the queue must "
+                  "be positive.");
+
+    for (int i = 0; i < worker_count; i++)
+      {
+        state_.push_back(std::unique_ptr<Ops>(new Ops()));
+        state_.back()->Deserialize(snapshot);
+      }
+    for (std::size_t i = 0; i < state_.size(); i++)
+      worker_.push_back(std::thread(&ApplyPool::Work, this, i));
+  }
+
+
+  //! Destructor.
+  /*! The queued and parked calls are run before the worker threads exit.
+   */
+  ApplyPool::~ApplyPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+    for (std::size_t i = 0; i < worker_.size(); i++)
+      worker_[i].join();
+  }
+
+
+  //! Queues a call, waiting for room in the queue if necessary.
+  /*! The calling thread is blocked while the queue is full.
+    \param[in] call the call.
+    \return A future that becomes ready once the call is completed. Its
+    method 'get' rethrows the exception that escaped the call, if any.
+  */
+  std::future<void> ApplyPool::Submit(Call call)
+  {
+    std::shared_ptr<std::promise<void> > done(new std::promise<void>());
+    std::future<void> future = done->get_future();
+    Job job;
+    job.call = [call, done](Ops& ops)
+      {
+        try
+          {
+            call(ops);
+          }
+        catch(...)
+          {
+            done->set_exception(std::current_exception());
+            return;
+          }
+        done->set_value();
+      };
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]()
+                   {
+                     return stop_ || queue_.size() < queue_capacity_;
+                   });
+    if (stop_)
+      throw Error("ApplyPool::Submit", "The pool is stopped.");
+    queue_.push_back(std::move(job));
+    lock.unlock();
+    not_empty_.notify_one();
+    return future;
+  }
+
+
+  //! Queues a call, or parks it if the queue is full.
+  /*! The calling thread is never blocked. A parked call is moved to the
+    queue as soon as there is room, before any call submitted later. This is
+    meant for callers that wait for the completion without blocking (e.g.,
+    suspended coroutines). At most 'GetQueueCapacity()' calls are parked:
+    beyond, the call is rejected, and the caller should report the overload
+    or retry later.
+    \param[in] call the call.
+    \param[in] completion the function run once the call is completed, with
+    the exception that escaped the call, if any. It is run by the executor
+    of the pool, if any, or in the worker thread.
+    \return True if the call was queued or parked, false if it was rejected.
+  */
+  bool ApplyPool::Post(Call call, Completion completion)
+  {
+    if (!completion)
+      throw Error("ApplyPool::Post", "A completion is required.");
+    Job job = {std::move(call), std::move(completion)};
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_)
+        throw Error("ApplyPool::Post", "The pool is stopped.");
+      if (queue_.size() >= queue_capacity_)
+        {
+          if (parked_.size() >= queue_capacity_)
+            return false;
+          parked_.push_back(std::move(job));
+          return true;
+        }
+      queue_.push_back(std::move(job));
+    }
+    not_empty_.notify_one();
+    return true;
+  }
+
+
+  //! Returns the number of worker threads.
+  /*!
+    \return The number of worker threads.
+  */
+  int ApplyPool::GetWorkerCount() const
+  {
+    return static_cast<int>(worker_.size());
+  }
+
+
+  //! Returns the maximum number of queued calls.
+  /*!
+    \return The maximum number of queued calls.
+  */
+  std::size_t ApplyPool::GetQueueCapacity() const
+  {
+    return queue_capacity_;
+  }
+
+
+  //! Returns the number of queued calls.
+  /*!
+    \return The number of queued calls, not yet run.
+  */
+  std::size_t ApplyPool::GetQueueSize()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+
+  //! Returns the number of parked calls.
+  /*!
+    \return The number of calls posted while the queue was full, and not
+    queued yet.
+  */
+  std::size_t ApplyPool::GetParkedCount()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return parked_.size();
+  }
+
+
+  //! Runs the calls, in a worker thread.
+  /*!
+    \param[in] index index of the worker.
+  */
+  void ApplyPool::Work(std::size_t index)
+  {
+    Ops& ops = *state_[index];
+    while (true)
+      {
+        Job job;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          not_empty_.wait(lock, [this]()
+                          {
+                            return stop_ || !queue_.empty();
+                          });
+          if (queue_.empty())
+            return;
+          job = std::move(queue_.front());
+          queue_.pop_front();
+          if (!parked_.empty())
+            {
+              queue_.push_back(std::move(parked_.front()));
+              parked_.pop_front();
+            }
+          else
+            not_full_.notify_one();
+        }
+
+        // No exception may stop the worker: it is given to the completion.
+        // The calls of 'Submit' handle their exceptions.
+        std::exception_ptr error;
+        try
+          {
+            job.call(ops);
+          }
+        catch(...)
+          {
+            error = std::current_exception();
+          }
+        if (job.completion)
+          {
+            if (executor_)
+              executor_(std::bind(job.completion, error));
+            else
+              job.completion(error);
+          }
+      }
+  }
+
+
+}
+
+
+#define OPS_FILE_APPLYPOOL_CXX
+#endif
@@ -0,0 +1,193 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+
+#ifndef OPS_FILE_APPLYPOOL_HXX
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Error.hxx"
+
+// 'Ops::ApplyAsync' requires C++20 coroutines.
+#if !defined(SWIG) && defined(__cpp_impl_coroutine)
+#define OPS_WITH_COROUTINE
+#include <coroutine>
+#endif
+
+
+namespace Ops
+{
+
+
+  class Ops;
+
+
+  //! Pool of Lua states that run calls in worker threads.
+  /*! Every worker thread owns a Lua state, loaded from a snapshot of a
+    configuration (see 'Ops::Serialize'). The calls are queued in a bounded
+    queue. When the queue is full, 'Submit' blocks the calling thread, while
+    'Post' parks the call until there is room in the queue, without blocking.
+    The number of parked calls is bounded by the capacity of the queue as
+    well: beyond, 'Post' rejects the calls. See 'Ops::StartApplyPool' and
+    'Ops::ApplyAsync'.
+  */
+  class ApplyPool
+  {
+  public:
+    //! Call run by a worker, with the Lua state of the worker.
+    typedef std::function<void(Ops&)> Call;
+    //! Function run once a call is completed, with the exception that
+    //! escaped the call, if any.
+    typedef std::function<void(std::exception_ptr)> Completion;
+    //! Runs a completion, e.g., by posting it to an event loop.
+    typedef std::function<void(std::function<void()>)> Executor;
+
+  protected:
+    //! A call and its completion.
+    struct Job
+    {
+      Call call;
+      Completion completion;
+    };
+
+    //! Lua states of the workers.
+    std::vector<std::unique_ptr<Ops> > state_;
+    //! Worker threads.
+    std::vector<std::thread> worker_;
+    //! Maximum number of queued calls.
+    std::size_t queue_capacity_;
+    //! Queued calls.
+    std::deque<Job> queue_;
+    //! Calls posted while the queue was full, at most 'queue_capacity_'.
+    std::deque<Job> parked_;
+    //! Runs the completions, or empty to run them in the worker threads.
+    Executor executor_;
+    //! Protects the queues and 'stop_'.
+    std::mutex mutex_;
+    //! Signaled when a call is queued or when the pool stops.
+    std::condition_variable not_empty_;
+    //! Signaled when a call leaves the queue.
+    std::condition_variable not_full_;
+    //! Is the pool stopping?
+    bool stop_;
+
+  public:
+    // Constructor and destructor.
+    ApplyPool(const std::string& snapshot, int worker_count,
+              std::size_t queue_capacity, Executor executor = Executor());
+    ~ApplyPool();
+
+    std::future<void> Submit(Call call);
+    bool Post(Call call, Completion completion);
+
+    // Access methods.
+    int GetWorkerCount() const;
+    std::size_t GetQueueCapacity() const;
+    std::size_t GetQueueSize();
+    std::size_t GetParkedCount();
+
+  protected:
+    void Work(std::size_t index);
+
+  private:
+    ApplyPool(const ApplyPool&);
+    ApplyPool& operator=(const ApplyPool&);
+  };
+
+
+#ifdef OPS_WITH_COROUTINE
+  //! Awaitable call of a Lua function in a pool of Lua states.
+  /*! The awaiting coroutine is suspended while the call is queued (or
+    parked, if the queue is full) and run. It is resumed by the executor of
+    the pool, or in the worker thread. If the call cannot even be parked,
+    the coroutine is not suspended and 'co_await' raises an exception. See
+    'Ops::ApplyAsync'.
+  */
+  template<class T>
+  class ApplyAwaiter
+  {
+  protected:
+    //! The pool.
+    ApplyPool& pool_;
+    //! The call, which returns the result.
+    std::function<T(Ops&)> call_;
+    //! The result.
+    T result_;
+    //! The exception raised by the call, if any.
+    std::exception_ptr error_;
+    //! Was the call rejected by the pool?
+    bool rejected_;
+
+  public:
+    ApplyAwaiter(ApplyPool& pool, std::function<T(Ops&)> call):
+      pool_(pool), call_(std::move(call)), result_(), rejected_(false)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+      return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+      // Once the call is posted, the coroutine may be resumed (and this
+      // object destroyed) before 'Post' returns.
+      bool posted = pool_.Post([this](Ops& ops)
+                               {
+                                 result_ = call_(ops);
+                               },
+                               [this, handle](std::exception_ptr error)
+                               {
+                                 error_ = error;
+                                 handle.resume();
+                               });
+      if (!posted)
+        rejected_ = true;
+      return posted;
+    }
+
+    T await_resume()
+    {
+      if (rejected_)
+        throw Error("ApplyAsync", "The pool of Lua states is full: "
+                    + std::to_string(pool_.GetQueueCapacity())
+                    + " calls are queued, and as many are parked.");
+      if (error_)
+        std::rethrow_exception(error_);
+      return std::move(result_);
+    }
+  };
+#endif
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_APPLYPOOL_HXX
+#endif
@@ -22,11 +22,20 @@
 #include "OpsHeader.hxx"
 #include "ClassOps.hxx"
 
+#include <thread>
+
+#include "ApplyPool.hxx"
+#include "Journal.hxx"
+
 
 namespace Ops
 {
 
 
+  char Ops::inheritance_cache_key_ = 0;
+  char Ops::ops_module_key_ = 0;
+
+
   /////////////////////////////////
   // CONSTRUCTORS AND DESTRUCTOR //
   /////////////////////////////////
@@ -35,23 +44,12 @@ namespace Ops
   //! Default constructor.
   /*! Nothing is performed. A Lua state is opened.
    */
-  Ops::Ops()
+  Ops::Ops():
+    state_(NULL), read_(new ReadEntries()), read_shared_(false),
+    record_open_report_(false), journal_(new Journal()), raw_access_(false),
+    deferred_validation_(false)
   {
-    state_ = luaL_newstate();
-    luaL_openlibs(state_);
-
-    // Defines 'ops_in' for the user. It checks whether an element is in a
-    // table.
-    std::string code = "function ops_in(v, table)\
-    for _, value in ipairs(table) do        \
-        if v == value then                  \
-            return true                     \
-        end                                 \
-    end                                     \
-    return false                            \
-    end";
-    if (luaL_dostring(state_, code.c_str()))
-      throw Error("Ops()", lua_tostring(state_, -1));
+    NewState();
   }
 
 
@@ -61,17 +59,23 @@ namespace Ops
     \param[in] file_path path to the configuration file.
   */
   Ops::Ops(std::string file_path):
-    file_path_(file_path), state_(NULL)
+    file_path_(file_path), state_(NULL), read_(new ReadEntries()),
+    read_shared_(false), record_open_report_(false), journal_(new Journal()),
+    raw_access_(false), deferred_validation_(false)
   {
     Open(file_path_);
   }
 
 
   //! Destructor.
-  /*! Destroys the Lua state object.
+  /*! Destroys the Lua state object. Unlike in 'Close', the constraints
+    deferred and not checked yet (see 'SetDeferredValidation') are discarded
+    without being checked, since a destructor may not raise an exception.
    */
   Ops::~Ops()
   {
+    // No exception may be raised by 'Validate' here.
+    deferred_constraint_.clear();
     Close();
   }
 
@@ -83,34 +87,17 @@ namespace Ops
 
   //! Opens a new configuration file.
   /*! The previous configuration file (if any) is closed. The prefix is
-    cleared.
+    cleared. If 'EnableOpenReport' was called, the phases are recorded (see
+    'OpenReport').
     \param[in] file_path path to the configuration file.
     \param[in] close_state should the Lua state be closed?
+    \warning If \a close_state is true, the constraints deferred and not
+    checked yet are checked first (see 'Close'): an exception is raised if any
+    of them is not satisfied.
   */
   void Ops::Open(std::string file_path, bool close_state)
   {
-    if (close_state)
-      {
-        Close();
-        state_ = luaL_newstate();
-        luaL_openlibs(state_);
-        // Defines 'ops_in' for the user. It checks whether an element is in a
-        // table.
-        std::string code = "function ops_in(v, table)\
-        for _, value in ipairs(table) do        \
-            if v == value then                  \
-                return true                     \
-            end                                 \
-        end                                     \
-        return false                            \
-        end";
-        if (luaL_dostring(state_, code.c_str()))
-          throw Error("Open(std::string, bool)", lua_tostring(state_, -1));
-      }
-
-    ClearPrefix();
-    file_path_ = file_path;
-    if (luaL_dofile(state_, file_path_.c_str()))
+    if (TryOpen(file_path, close_state) != 0)
       throw Error("Open(std::string, bool)", lua_tostring(state_, -1));
   }
 
@@ -119,6 +106,8 @@ namespace Ops
   /*! The configuration file is closed and reopened.
     \param[in] close_state should the Lua state be closed before reloading the
     file?
+    \warning As in 'Open', the constraints deferred and not checked yet may
+    raise an exception if \a close_state is true.
   */
   void Ops::Reload(bool close_state)
   {
@@ -127,27 +116,264 @@ namespace Ops
 
 
   //! Closes the configuration file (if any is open).
-  /*! Destroys the Lua state object. The prefix is cleared.
+  /*! Destroys the Lua state object. The prefix is cleared. The constraints
+    deferred and not checked yet (see 'SetDeferredValidation') are checked
+    first, with 'Validate', which raises an exception if any of them is not
+    satisfied.
   */
   void Ops::Close()
   {
+    bool pending;
+    {
+      std::lock_guard<std::mutex> lock(deferred_mutex_);
+      pending = !deferred_constraint_.empty();
+    }
+    if (pending)
+      Validate();
+
     ClearPrefix();
-    read_bool.clear();
-    read_int.clear();
-    read_float.clear();
-    read_double.clear();
-    read_string.clear();
-    read_vect_bool.clear();
-    read_vect_int.clear();
-    read_vect_float.clear();
-    read_vect_double.clear();
-    read_vect_string.clear();
+    read_ = std::make_shared<ReadEntries>();
+    read_shared_ = false;
     if (state_ != NULL)
       lua_close(state_);
     state_ = NULL;
   }
 
 
+  //! Applies a Lua function to arrays of arguments.
+  /*! The function is looked up once and called \a size times. The i-th call
+    takes the i-th elements of the \a Narg input arrays as arguments, and its
+    first returned value is stored in out[i].
+    \param[in] name name of the function.
+    \param[in] Narg number of arguments of the function.
+    \param[in] in the \a Narg input arrays, each of size \a size.
+    \param[in] size number of calls.
+    \param[out] out array of size \a size that receives the outputs.
+    \note The prefix is prepended to \a name.
+  */
+  void Ops::ApplyArray(std::string name, int Narg, const double* const* in,
+                       std::size_t size, double* out)
+  {
+    OPS_INSTRUMENT(instrument_apply, name);
+    ProfilerContext profiler_context(profiler_, "Apply", name);
+
+    PutOnStack(Name(name));
+    if (!lua_isfunction(state_, -1))
+      throw Error("ApplyArray", "The " + Function(name) + " was not found.");
+    int function = lua_gettop(state_);
+
+    if (!lua_checkstack(state_, Narg + 1))
+      throw Error("ApplyArray", "Too many arguments for the "
+                  + Function(name) + ".");
+
+    for (std::size_t i = 0; i < size; i++)
+      {
+        lua_pushvalue(state_, function);
+        for (int j = 0; j < Narg; j++)
+          lua_pushnumber(state_, static_cast<lua_Number>(in[j][i]));
+
+        if (lua_pcall(state_, Narg, 1, 0) != 0)
+          throw Error("ApplyArray",
+                      "While calling " + Function(name) + ":\n  "
+                      + lua_tostring(state_, -1));
+        if (!lua_isnumber(state_, -1))
+          throw Error("ApplyArray", "The returned value of \"" + Name(name)
+                      + "\" is not a number.");
+
+        out[i] = static_cast<double>(lua_tonumber(state_, -1));
+        lua_pop(state_, 1);
+      }
+
+    ClearStack();
+  }
+
+
+#ifdef OPS_WITH_VALUE
+  //! Retrieves an entry whose type is not known in advance.
+  /*! The type is determined from the Lua value, with a single lookup of the
+    entry and a single pass over a table: a Boolean gives a bool, a number
+    gives an int if it is an integer in the range of int and a double
+    otherwise, and a string gives a std::string. A table gives a vector if
+    all its elements are Booleans, numbers or strings, and of the same type.
+    A table of numbers gives a vector of int if all elements are integers in
+    the range of int, and a vector of double otherwise (including for an
+    empty table). Other values raise an exception. As with the typed
+    methods, the entry is recorded as read.
+    \param[in] name name of the entry.
+    \return The value of the entry.
+    \note The prefix is prepended to \a name.
+  */
+  template<>
+  Value Ops::Get<Value>(std::string name)
+  {
+    PutOnStack(Name(name));
+    return GetOnStack(name);
+  }
+
+
+  //! Converts the entry on top of the stack, whose type is not known.
+  /*! The conversion is the one of 'Get<Value>', and the entry is recorded
+    as read, but the entry is not looked up: it must have been put on the
+    stack with 'PutOnStack'. The stack is cleared.
+    \param[in] name name of the entry, for the record of the entries read
+    and for the error messages.
+    \return The value of the entry.
+    \note The prefix is prepended to \a name.
+  */
+  Value Ops::GetOnStack(std::string name)
+  {
+    int type = lua_type(state_, -1);
+
+    Value value;
+    if (type == LUA_TNIL)
+      throw Error("Get<Value>", "The " + Entry(name) + " was not found.");
+    else if (type == LUA_TBOOLEAN)
+      {
+        bool element = static_cast<bool>(lua_toboolean(state_, -1));
+        Push(Name(name), element);
+        value = element;
+      }
+    else if (type == LUA_TNUMBER)
+      {
+        double number = static_cast<double>(lua_tonumber(state_, -1));
+        if (number >= INT_MIN && number <= INT_MAX
+            && static_cast<double>(static_cast<int>(number)) == number)
+          {
+            int integer = static_cast<int>(number);
+            Push(Name(name), integer);
+            value = integer;
+          }
+        else
+          {
+            Push(Name(name), number);
+            value = number;
+          }
+      }
+    else if (type == LUA_TSTRING)
+      {
+        std::size_t length;
+        const char* element = lua_tolstring(state_, -1, &length);
+        std::string output(element, length);
+        Push(Name(name), output);
+        value = output;
+      }
+    else if (type == LUA_TTABLE)
+      {
+        int element_type = LUA_TNONE;
+        bool integral = true;
+        std::vector<bool> vect_bool;
+        std::vector<double> vect_double;
+        std::vector<std::string> vect_string;
+        Flatten();
+        lua_pushnil(state_);
+        while (lua_next(state_, -2) != 0)
+          {
+            int current_type = lua_type(state_, -1);
+            if (element_type == LUA_TNONE)
+              element_type = current_type;
+            else if (current_type != element_type)
+              throw Error("Get<Value>", "The elements of the " + Entry(name)
+                          + " do not all have the same type.");
+
+            if (current_type == LUA_TBOOLEAN)
+              vect_bool.push_back(static_cast<bool>
+                                  (lua_toboolean(state_, -1)));
+            else if (current_type == LUA_TNUMBER)
+              {
+                double number = static_cast<double>(lua_tonumber(state_, -1));
+                integral = integral && number >= INT_MIN && number <= INT_MAX
+                  && static_cast<double>(static_cast<int>(number)) == number;
+                vect_double.push_back(number);
+              }
+            else if (current_type == LUA_TSTRING)
+              {
+                // The value is a string, so that 'lua_tolstring' does not
+                // modify it and does not interfere with 'lua_next'.
+                std::size_t length;
+                const char* element = lua_tolstring(state_, -1, &length);
+                vect_string.push_back(std::string(element, length));
+              }
+            else
+              throw Error("Get<Value>", "The " + Entry(name) + " contains a "
+                          + std::string(lua_typename(state_, current_type))
+                          + ", which cannot be converted.");
+            lua_pop(state_, 1);
+          }
+
+        if (element_type == LUA_TBOOLEAN)
+          {
+            Push(Name(name), vect_bool);
+            value = vect_bool;
+          }
+        else if (element_type == LUA_TSTRING)
+          {
+            Push(Name(name), vect_string);
+            value = vect_string;
+          }
+        else if (integral && element_type == LUA_TNUMBER)
+          {
+            std::vector<int> vect_int(vect_double.begin(),
+                                      vect_double.end());
+            Push(Name(name), vect_int);
+            value = vect_int;
+          }
+        else
+          {
+            Push(Name(name), vect_double);
+            value = vect_double;
+          }
+      }
+    else
+      throw Error("Get<Value>", "The " + Entry(name) + " is a "
+                  + std::string(lua_typename(state_, type))
+                  + ", which cannot be converted.");
+
+    ClearStack();
+    return value;
+  }
+#endif
+
+
+  //! Starts the pool of Lua states used by 'ApplyAsync'.
+  /*! Each worker of the pool owns a Lua state, loaded from a snapshot of the
+    current configuration (see 'Serialize'): the later changes of the
+    configuration are not seen by the pool, unless it is started again. The
+    pool previously started, if any, is stopped. The pool should be started
+    before the calls to 'ApplyAsync', which may then come from several
+    threads.
+    \param[in] worker_count number of workers, or 0 for the number of
+    hardware threads.
+    \param[in] queue_capacity maximum number of queued calls. The calls made
+    while the queue is full wait for room, without blocking their thread. At
+    most as many calls wait: beyond, 'co_await' raises an exception.
+    \param[in] executor runs the completions, that is, resumes the awaiting
+    coroutines (e.g., by posting them to an event loop). If it is empty, the
+    coroutines are resumed in the worker threads.
+    \warning Without executor, a coroutine resumed by a worker runs in the
+    worker thread until it is suspended again, and the worker does not run
+    any other call meanwhile. An executor should be given unless the
+    coroutines are short.
+  */
+  void Ops::StartApplyPool(int worker_count, std::size_t queue_capacity,
+                           ApplyPool::Executor executor)
+  {
+    StopApplyPool();
+    if (worker_count == 0)
+      worker_count = std::max(1, int(std::thread::hardware_concurrency()));
+    apply_pool_.reset(new ApplyPool(Serialize(), worker_count,
+                                    queue_capacity, executor));
+  }
+
+
+  //! Stops the pool of Lua states used by 'ApplyAsync'.
+  /*! The pending calls are completed first.
+   */
+  void Ops::StopApplyPool()
+  {
+    apply_pool_.reset();
+  }
+
+
   //! Returns the list of entries inside an entry.
   /*!
     \param[in] name name of the entry to search in.
@@ -169,6 +395,9 @@ namespace Ops
       throw Error("GetEntryList",
                   "The " + Entry(name) + " does not contain other entries.");
 
+    // The inherited entries are listed as well.
+    Flatten();
+
     std::vector<std::string> key_list;
     std::string key;
     // Now loops over all elements of the table.
@@ -208,6 +437,9 @@ namespace Ops
     if (constraint == "")
       return true;
 
+    OPS_INSTRUMENT(instrument_constraint, name);
+    ProfilerContext profiler_context(profiler_, "Constraint", name);
+
     std::string code;
     code = "function ops_check_constraint(v)\nreturn " + constraint \
       + "\nend\nops_result = ops_check_constraint(" + Name(name) + ")";
@@ -238,6 +470,9 @@ namespace Ops
     if (constraint == "")
       return true;
 
+    OPS_INSTRUMENT(instrument_constraint, value);
+    ProfilerContext profiler_context(profiler_, "Constraint", value);
+
     std::string code;
     code = "function ops_check_constraint(v)\nreturn " + constraint \
       + "\nend\nops_result = ops_check_constraint(" + value + ")";
@@ -256,15 +491,93 @@ namespace Ops
   }
 
 
+  //! Checks the constraints deferred so far.
+  /*! In deferred mode (see 'SetDeferredValidation'), the entries read with a
+    constraint are recorded, and their constraints are checked here, in bulk:
+    every constraint is compiled once. The recorded entries are then
+    discarded.
+    \note If any constraint is not satisfied, an exception is raised, which
+    lists all failures.
+  */
+  void Ops::Validate()
+  {
+    std::vector<std::pair<std::string, std::string> > constraint;
+    {
+      std::lock_guard<std::mutex> lock(deferred_mutex_);
+      constraint.swap(deferred_constraint_);
+    }
+
+    std::vector<std::string> failure = CheckConstraints(constraint);
+    if (!failure.empty())
+      {
+        std::ostringstream message;
+        message << failure.size() << " constraint(s) not satisfied:";
+        for (std::size_t i = 0; i < failure.size(); i++)
+          message << "\n  " << failure[i];
+        throw Error("Validate", message.str());
+      }
+  }
+
+
+  //! Checks the constraints deferred so far, in another thread.
+  /*! The constraints are checked as in 'Validate', but in another Lua state,
+    loaded from a snapshot of the configuration (see 'Serialize'), and in
+    another thread. This object may be used, or destroyed, in the meantime.
+    The entries are checked as they are in the snapshot, taken when this
+    method is called.
+    \return A future that becomes ready once the constraints are checked.
+    Its value is the list of the constraints that are not satisfied, as
+    described in the exception of 'Validate'. The failures are not raised,
+    so that the caller decides where to report them. With
+    OPS_WITH_EXCEPTION, an error raised while the snapshot is loaded is
+    reported in the list as well.
+    \warning With OPS_WITH_ABORT, an error while loading the snapshot aborts
+    the program. The snapshot is written by this object, so that this only
+    happens if the memory is exhausted.
+  */
+  std::future<std::vector<std::string> > Ops::ValidateAsync()
+  {
+    std::vector<std::pair<std::string, std::string> > constraint;
+    {
+      std::lock_guard<std::mutex> lock(deferred_mutex_);
+      constraint.swap(deferred_constraint_);
+    }
+    std::string snapshot = Serialize();
+    return std::async(std::launch::async, [constraint, snapshot]()
+                      {
+#ifdef OPS_WITH_EXCEPTION
+                        try
+                          {
+                            Ops ops;
+                            ops.Deserialize(snapshot);
+                            return ops.CheckConstraints(constraint);
+                          }
+                        catch(Error& e)
+                          {
+                            return std::vector<std::string>
+                              (1, "While loading the snapshot:\n  "
+                               + e.What());
+                          }
+#else
+                        Ops ops;
+                        ops.Deserialize(snapshot);
+                        return ops.CheckConstraints(constraint);
+#endif
+                      });
+  }
+
+
   //! Puts \a name on top of the stack.
-  /*! If \a name is a simple variable, it calls 'lua_getglobal' once. But if
-    \a name is encapsulated in a table, this method iterates until it finds
-    the variable.
+  /*! If \a name is a simple variable, it is read once in the global table.
+    But if \a name is encapsulated in a table, this method iterates until it
+    finds the variable.
     \param[in] name the name of the entry to be put on top of the stack.
     \note The prefix is not prepended to \a name.
   */
   void Ops::PutOnStack(std::string name)
   {
+    OPS_INSTRUMENT(instrument_resolve, name);
+
     if (name.empty())
       {
 #if LUA_VERSION_NUM > 501
@@ -282,13 +595,16 @@ namespace Ops
         lua_pushnil(state_);
         return;
       }
+    PutOnStack("");
     if (end == std::string::npos)
       {
-        lua_getglobal(state_, name.c_str());
+        GetField(name);
+        lua_remove(state_, -2);
         return;
       }
 
-    lua_getglobal(state_, name.substr(0, end).c_str());
+    GetField(name.substr(0, end));
+    lua_remove(state_, -2);
 
     if (name[end] == '.')
       WalkDown(name.substr(end + 1).c_str());
@@ -403,6 +719,7 @@ namespace Ops
   */
   void Ops::DoFile(std::string file_path)
   {
+    ClearInheritanceCache();
     if (luaL_dofile(state_, file_path.c_str()))
       throw Error("DoFile(std::string)", lua_tostring(state_, -1));
   }
@@ -414,11 +731,297 @@ namespace Ops
   */
   void Ops::DoString(std::string expression)
   {
+    ClearInheritanceCache();
     if (luaL_dostring(state_, expression.c_str()))
       throw Error("DoString(std::string)", lua_tostring(state_, -1));
   }
 
 
+  //! Opens a journal of the overridden entries.
+  /*! Every entry overridden with 'Override' is then appended to the journal
+    with its value. After a restart, the overrides are restored by opening
+    the configuration file and replaying the journal ('ReplayJournal'). The
+    journal previously open, if any, is closed.
+    \param[in] file_path path to the journal. It is created if it does not
+    exist; otherwise the records are appended to it.
+    \param[in] sync_period number of records between two flushes of the
+    journal to the disk.
+    \param[in] compaction_period number of records between two compactions
+    of the journal (see 'Journal::Compact'), or 0 for no automatic
+    compaction.
+  */
+  void Ops::OpenJournal(std::string file_path, int sync_period,
+                        int compaction_period)
+  {
+    journal_->Open(file_path, sync_period, compaction_period);
+  }
+
+
+  //! Flushes the journal to the disk and closes it.
+  void Ops::CloseJournal()
+  {
+    journal_->Close();
+  }
+
+
+  //! Restores the entries recorded in a journal.
+  /*! The records are applied in chronological order, directly in the Lua
+    tables. They are not appended to the open journal, if any.
+    \param[in] file_path path to the journal.
+  */
+  void Ops::ReplayJournal(std::string file_path)
+  {
+    std::vector<std::pair<std::string, std::string> > record
+      = Journal::Read(file_path);
+    for (std::size_t i = 0; i < record.size(); i++)
+      {
+        // Tables already created, indexed by their position in the value.
+        lua_newtable(state_);
+        int table_index = lua_gettop(state_);
+        std::size_t position = 0;
+        DeserializeValue(record[i].second, position, table_index);
+        Assign(record[i].first, false);
+        lua_pop(state_, 1);
+      }
+  }
+
+
+  //! Serializes the evaluated configuration into a binary buffer.
+  /*! All global entries are serialized, except the standard Lua libraries.
+    Tables and functions shared by several entries (or containing
+    themselves) are serialized once. The Lua functions are serialized as
+    bytecode, with their upvalues. The buffer can be loaded into another
+    object with 'Deserialize', without running the configuration file again.
+    The format is:
+    - the header: "OPSSNAP" followed by '\0', the format version (32-bit
+    integer, which also identifies the byte order), the length of the path to
+    the configuration file (32-bit integer) and the path itself;
+    - the global table, as a value.
+    A value starts with a one-byte tag. A Boolean and nil have no payload. A
+    number is a double. A string is its length (32-bit integer) followed by
+    its characters. A table is its number of entries (32-bit integer) and the
+    size in bytes of these entries (64-bit integer), followed by the entries
+    as key/value pairs of values. A function is its number of upvalues
+    (32-bit integer) and the size in bytes of the rest of the function
+    (64-bit integer), followed by the length of its bytecode (32-bit integer),
+    the bytecode and the upvalues. An upvalue is either a zero byte followed
+    by a value, or a non-zero byte followed by the position (64-bit integer)
+    of a function already serialized and the index (32-bit integer) of the
+    upvalue of this function that it shares. A table or a function already
+    serialized is a reference: the position (64-bit integer) of its tag in
+    the buffer. An object of the standard libraries (e.g., the function
+    'print' or the table 'string') is its name, serialized as a string.
+    The lazy tables (see 'ops.lazy') and the thunks (see 'ops.thunk') are
+    evaluated first. The metatables are not serialized: except in raw mode,
+    the entries a table inherits through '__index' (see 'Flatten') are
+    written as entries of the table.
+    \return The buffer.
+    \note The values are in the byte order of the machine. The bytecode can
+    only be loaded by the same version of Lua.
+    \warning A function whose upvalues cannot be serialized (e.g., a
+    coroutine) raises an exception.
+  */
+  std::string Ops::Serialize()
+  {
+    OPS_INSTRUMENT(instrument_serialize, file_path_);
+
+    std::string buffer("OPSSNAP", 8);
+    SerializeRaw(static_cast<uint32_t>(snapshot_version_), buffer);
+    SerializeRaw(static_cast<uint32_t>(file_path_.size()), buffer);
+    buffer += file_path_;
+
+    // The lazy tables are part of the configuration. They can only be
+    // defined if the module 'ops' was loaded.
+    lua_pushlightuserdata(state_, &ops_module_key_);
+    lua_rawget(state_, LUA_REGISTRYINDEX);
+    if (lua_isfunction(state_, -1))
+      {
+        if (lua_pcall(state_, 0, 0, 0) != 0)
+          throw Error("Serialize", lua_tostring(state_, -1));
+      }
+    else
+      lua_pop(state_, 1);
+
+    SnapshotWriter writer;
+    IndexLibrary(writer);
+    PutOnStack("");
+    SerializeValue(-1, buffer, writer, true);
+    ClearStack();
+
+    return buffer;
+  }
+
+
+  //! Loads a configuration serialized by 'Serialize'.
+  /*! The Lua state is closed and a new state is opened, in which the
+    serialized entries are defined. The configuration file is not run, and the
+    prefix is cleared.
+    \param[in] buffer the buffer returned by 'Serialize'.
+    \warning Lua does not check the bytecode of the functions: the buffer
+    should come from a trusted source.
+    \warning The constraints deferred and not checked yet are checked when
+    the state is closed (see 'Close'): an exception is raised if any of them
+    is not satisfied.
+  */
+  void Ops::Deserialize(const std::string& buffer)
+  {
+    OPS_INSTRUMENT(instrument_deserialize, file_path_);
+
+    if (buffer.size() < 16 || buffer.compare(0, 8, std::string("OPSSNAP", 8)))
+      throw Error("Deserialize", "The buffer is not a serialized "
+                  "configuration.");
+    std::size_t position = 8;
+    // The first version had no functions, but is otherwise the same.
+    uint32_t version = DeserializeRaw<uint32_t>(buffer, position);
+    if (version != 1 && version != snapshot_version_)
+      throw Error("Deserialize", "The buffer was serialized with an "
+                  "unsupported format or byte order.");
+    uint32_t length = DeserializeRaw<uint32_t>(buffer, position);
+    if (buffer.size() - position < length)
+      throw Error("Deserialize", "The buffer is truncated.");
+
+    Close();
+    NewState();
+    // As in 'Open', the prefix of the previous configuration is discarded.
+    ClearPrefix();
+    file_path_ = buffer.substr(position, length);
+    position += length;
+
+    // Tables and functions already created, indexed by their position in the
+    // buffer.
+    lua_newtable(state_);
+    int table_index = lua_gettop(state_);
+
+    if (DeserializeRaw<unsigned char>(buffer, position) != snapshot_table_)
+      throw Error("Deserialize", "The global table is missing.");
+    PutOnStack("");
+    lua_pushnumber(state_, static_cast<lua_Number>(position - 1));
+    lua_pushvalue(state_, -2);
+    lua_rawset(state_, table_index);
+    DeserializeTable(buffer, position, table_index, lua_gettop(state_));
+
+    ClearStack();
+  }
+
+
+  //! Writes the evaluated configuration in a file.
+  /*! The file contains the buffer returned by 'Serialize'. It is written in a
+    temporary file, which then replaces \a file_path atomically.
+    \param[in] file_path path to the file.
+  */
+  void Ops::WriteSnapshot(std::string file_path)
+  {
+    std::string buffer = Serialize();
+
+    std::string temporary_path = file_path + ".tmp";
+    std::ofstream f(temporary_path.c_str(), std::ios::binary);
+    f.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    f.close();
+    if (!f.good())
+      {
+        std::remove(temporary_path.c_str());
+        throw Error("WriteSnapshot", "Failed to write in \"" + temporary_path
+                    + "\".");
+      }
+    if (std::rename(temporary_path.c_str(), file_path.c_str()) != 0)
+      {
+        std::remove(temporary_path.c_str());
+        throw Error("WriteSnapshot", "Failed to rename \"" + temporary_path
+                    + "\" to \"" + file_path + "\".");
+      }
+  }
+
+
+  //! Loads a configuration written by 'WriteSnapshot'.
+  /*! See 'Deserialize'.
+    \param[in] file_path path to the file.
+  */
+  void Ops::ReadSnapshot(std::string file_path)
+  {
+    std::ifstream f(file_path.c_str(), std::ios::binary);
+    if (!f.is_open())
+      throw Error("ReadSnapshot", "Unable to open \"" + file_path + "\".");
+    std::string buffer((std::istreambuf_iterator<char>(f)),
+                       std::istreambuf_iterator<char>());
+    if (f.bad())
+      throw Error("ReadSnapshot", "Failed to read \"" + file_path + "\".");
+    Deserialize(buffer);
+  }
+
+
+  //! Evaluates a configuration file on one process and sends it to others.
+  /*! The root process opens the configuration file and serializes the
+    configuration (see 'Serialize'), which \a broadcast sends to the other
+    processes. The other processes do not run the file: they load the buffer
+    received (see 'Deserialize'). Ops does not depend on the transport: with
+    MPI, \a broadcast would send the size and then the content of the buffer
+    with 'MPI_Bcast'. It must be called by all processes. The inherited
+    entries are sent as entries of the tables (see 'Serialize'), so that all
+    processes read the same values, provided the root process is not in raw
+    mode.
+    \param[in] file_path path to the configuration file.
+    \param[in] root is this process the one that runs the file?
+    \param[in] broadcast the function that sends the buffer.
+    \note If the file cannot be run on the root process, an empty buffer is
+    sent, so that an exception is raised on every process. The file is run
+    without raising, so that the buffer is sent before the exception is
+    raised, even when 'Error' aborts (OPS_WITH_ABORT).
+    \warning If the configuration cannot be serialized (see 'Serialize'),
+    the root process raises an exception before sending the buffer when
+    'Error' aborts: the other processes are then left waiting, unless the
+    transport stops them (e.g., MPI jobs are usually killed when a process
+    aborts). With OPS_WITH_EXCEPTION, an empty buffer is sent first.
+    \warning The constraints deferred and not checked yet are checked when
+    the state is closed (see 'Close'). On the root process, a failure raises
+    an exception before the buffer is sent: they should be validated before.
+  */
+  void Ops::OpenBroadcast(std::string file_path, bool root,
+                          const Broadcast& broadcast)
+  {
+    std::string buffer;
+    if (root)
+      {
+        std::string message;
+        bool failed = TryOpen(file_path, true) != 0;
+        if (failed)
+          {
+            const char* error = lua_tostring(state_, -1);
+            message = error == NULL ? "Unable to run \"" + file_path + "\"."
+              : error;
+          }
+        else
+          {
+#ifdef OPS_WITH_EXCEPTION
+            try
+              {
+                buffer = Serialize();
+              }
+            catch(...)
+              {
+                // The other processes must not wait for the buffer.
+                buffer.clear();
+                broadcast(buffer);
+                throw;
+              }
+#else
+            buffer = Serialize();
+#endif
+          }
+        // An empty buffer if the file could not be run.
+        broadcast(buffer);
+        if (failed)
+          throw Error("OpenBroadcast", message);
+        return;
+      }
+
+    broadcast(buffer);
+    if (buffer.empty())
+      throw Error("OpenBroadcast", "The configuration file \"" + file_path
+                  + "\" could not be run on the root process.");
+    Deserialize(buffer);
+  }
+
+
   ////////////////////
   // ACCESS METHODS //
   ////////////////////
@@ -488,23 +1091,7 @@ namespace Ops
   */
   std::vector<std::string> Ops::GetReadEntryList()
   {
-    std::vector<std::string> name_list;
-    AppendKey(read_bool, name_list);
-    AppendKey(read_int, name_list);
-    AppendKey(read_float, name_list);
-    AppendKey(read_double, name_list);
-    AppendKey(read_string, name_list);
-    AppendKey(read_vect_bool, name_list);
-    AppendKey(read_vect_int, name_list);
-    AppendKey(read_vect_float, name_list);
-    AppendKey(read_vect_double, name_list);
-    AppendKey(read_vect_string, name_list);
-
-    sort(name_list.begin(), name_list.end());
-    name_list.erase(std::unique(name_list.begin(), name_list.end()),
-                    name_list.end());
-
-    return name_list;
+    return GetReadEntries()->GetEntryList();
   }
 
 
@@ -517,42 +1104,49 @@ namespace Ops
   void Ops::UpdateLuaDefinition()
   {
     std::string prefix = prefix_;
+    // The entries are read from a copy, since 'Get' modifies them.
+    std::shared_ptr<const ReadEntries> entries = GetReadEntries();
 
-    for (std::map<std::string, bool>::iterator i = read_bool.begin();
-         i != read_bool.end(); i++)
+    for (std::map<std::string, bool>::const_iterator
+           i = entries->read_bool.begin();
+         i != entries->read_bool.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, int>::iterator i = read_int.begin();
-         i != read_int.end(); i++)
+    for (std::map<std::string, int>::const_iterator
+           i = entries->read_int.begin();
+         i != entries->read_int.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, float>::iterator i = read_float.begin();
-         i != read_float.end(); i++)
+    for (std::map<std::string, float>::const_iterator
+           i = entries->read_float.begin();
+         i != entries->read_float.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, double>::iterator i = read_double.begin();
-         i != read_double.end(); i++)
+    for (std::map<std::string, double>::const_iterator
+           i = entries->read_double.begin();
+         i != entries->read_double.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, std::string>::iterator i = read_string.begin();
-         i != read_string.end(); i++)
+    for (std::map<std::string, std::string>::const_iterator
+           i = entries->read_string.begin();
+         i != entries->read_string.end(); i++)
       Get(i->first, "", i->second);
 
-    for (std::map<std::string, std::vector<bool> >::iterator
-           i = read_vect_bool.begin();
-         i != read_vect_bool.end(); i++)
+    for (std::map<std::string, std::vector<bool> >::const_iterator
+           i = entries->read_vect_bool.begin();
+         i != entries->read_vect_bool.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, std::vector<int> >::iterator
-           i = read_vect_int.begin();
-         i != read_vect_int.end(); i++)
+    for (std::map<std::string, std::vector<int> >::const_iterator
+           i = entries->read_vect_int.begin();
+         i != entries->read_vect_int.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, std::vector<float> >::iterator
-           i = read_vect_float.begin();
-         i != read_vect_float.end(); i++)
+    for (std::map<std::string, std::vector<float> >::const_iterator
+           i = entries->read_vect_float.begin();
+         i != entries->read_vect_float.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, std::vector<double> >::iterator
-           i = read_vect_double.begin();
-         i != read_vect_double.end(); i++)
+    for (std::map<std::string, std::vector<double> >::const_iterator
+           i = entries->read_vect_double.begin();
+         i != entries->read_vect_double.end(); i++)
       Get(i->first, "", i->second);
-    for (std::map<std::string, std::vector<std::string> >::iterator
-           i = read_vect_string.begin();
-         i != read_vect_string.end(); i++)
+    for (std::map<std::string, std::vector<std::string> >::const_iterator
+           i = entries->read_vect_string.begin();
+         i != entries->read_vect_string.end(); i++)
       Get(i->first, "", i->second);
 
     prefix_ = prefix;
@@ -568,152 +1162,11 @@ namespace Ops
   */
   std::string Ops::LuaDefinition(std::string name)
   {
-    std::ostringstream output;
-
-    // Below, the name is searched in all maps. When the name is found, its
-    // value is converted to a std::string (that Lua can process).
-
-    std::map<std::string, bool>::iterator i_bool = read_bool.find(name);
-    if (i_bool != read_bool.end())
-    {
-      if (i_bool->second)
-        output << name << " = true";
-      else
-        output << name << " = false";
-    }
-    // In case the entry was read under two different types, only one type is
-    // returned. So, once the entry is found, this method returns the
-    // definition.
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, int>::iterator i_int = read_int.find(name);
-    if (i_int != read_int.end())
-      output << name << " = " << i_int->second;
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, float>::iterator i_float = read_float.find(name);
-    if (i_float != read_float.end())
-      output << name << " = " << i_float->second;
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, double>::iterator i_double = read_double.find(name);
-    if (i_double != read_double.end())
-      output << name << " = " << i_double->second;
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, std::string>::iterator i_string = read_string.find(name);
-    if (i_string != read_string.end())
-      output << name << " = \"" << i_string->second << "\"";
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, std::vector<bool> >::iterator i_vect_bool
-      = read_vect_bool.find(name);
-    if (i_vect_bool != read_vect_bool.end())
-      {
-        output << name << " = {";
-        std::size_t size = i_vect_bool->second.size();
-
-        if (size != 0)
-          {
-            for (std::size_t i = 0; i < size - 1; i++)
-              if (i_vect_bool->second[i])
-                output << "true, ";
-              else
-                output << "false, ";
-
-            if (i_vect_bool->second[size - 1])
-              output << "true";
-            else
-              output << "false";
-          }
-
-        output << "}";
-      }
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, std::vector<int> >::iterator i_vect_int
-      = read_vect_int.find(name);
-    if (i_vect_int != read_vect_int.end())
-      {
-        output << name << " = {";
-        std::size_t size = i_vect_int->second.size();
-
-        if (size != 0)
-          {
-            for (std::size_t i = 0; i < size - 1; i++)
-              output << i_vect_int->second[i] << ", ";
-            output << i_vect_int->second[size - 1];
-          }
-        output << "}";
-      }
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, std::vector<float> >::iterator i_vect_float
-      = read_vect_float.find(name);
-    if (i_vect_float != read_vect_float.end())
-      {
-        output << name << " = {";
-        std::size_t size = i_vect_float->second.size();
-
-        if (size != 0)
-          {
-            for (std::size_t i = 0; i < size - 1; i++)
-              output << i_vect_float->second[i] << ", ";
-            output << i_vect_float->second[size - 1];
-          }
-        output << "}";
-      }
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, std::vector<double> >::iterator i_vect_double
-      = read_vect_double.find(name);
-    if (i_vect_double != read_vect_double.end())
-      {
-        output << name << " = {";
-        std::size_t size = i_vect_double->second.size();
-
-        if (size != 0)
-          {
-            for (std::size_t i = 0; i < size - 1; i++)
-              output << i_vect_double->second[i] << ", ";
-            output << i_vect_double->second[size - 1];
-          }
-        output << "}";
-      }
-    if (!output.str().empty())
-      return output.str();
-
-    std::map<std::string, std::vector<std::string> >::iterator i_vect_string
-      = read_vect_string.find(name);
-    if (i_vect_string != read_vect_string.end())
-      {
-        output << name << " = {";
-        std::size_t size = i_vect_string->second.size();
-
-        if (size != 0)
-          {
-            for (std::size_t i = 0; i < size - 1; i++)
-              output << "\"" << i_vect_string->second[i] << "\", ";
-            output << "\"" << i_vect_string->second[size - 1] << "\"";
-          }
-        output << "}";
-      }
-    if (!output.str().empty())
-      return output.str();
-
-    if (output.str() == "")
+    std::string definition = GetReadEntries()->LuaDefinition(name);
+    if (definition.empty())
       throw Error("LuaDefinition(std::string)", "Entry \"" + name
                   + "\" was not read yet in file \"" + file_path_ + "\".");
-
-    return output.str();
+    return definition;
   }
 
 
@@ -723,75 +1176,288 @@ namespace Ops
   */
   std::string Ops::LuaDefinition()
   {
-    std::vector<std::string> name_list = GetReadEntryList();
-
-    std::string output;
-    std::vector<std::string>::iterator name;
-    std::string previous_name = "";
-    for (name = name_list.begin(); name != name_list.end(); name++)
-      {
-        // If '*name' is (or is part of) a new variable, inserts a new
-        // line. Otherwise, '*name' is part of a table being written, so no
-        // newline should be inserted.
-        if (!previous_name.empty()
-            && previous_name.substr(0, previous_name.find("."))
-            != name->substr(0, name->find(".")))
-          output += "\n";
-
-        // Checks whether a new table is introduced. In this case, it should
-        // be declared first, with "name = {}".
-        if (name->find_first_of(".[") != std::string::npos)
-          {
-            std::string::size_type i = 0;
-            std::string::size_type min_length
-              = std::min(name->size(), previous_name.size());
-            // Checks until where the previous name and the current name
-            // coincide.
-            while (i < min_length && previous_name[i] == (*name)[i])
-              i++;
-            if (i < min_length
-                && (previous_name[i] == '.' || previous_name[i] == '[')
-                && ((*name)[i] == '.' || (*name)[i] == '['))
-              i++;
-            while ((i = name->find_first_of(".[", i)) != std::string::npos)
-              output += name->substr(0, i++) + " = {}\n";
-          }
-
-        output += LuaDefinition(*name) + "\n";
-
-        previous_name = *name;
-      }
-
-    return output;
+    return GetReadEntries()->LuaDefinition();
   }
 
 
   //! Writes the Lua definitions of all read variables.
-  /*! The variables are written in alphabetical order.
+  /*! The variables are written in alphabetical order. The definitions are
+    written in a temporary file, which then replaces the output file
+    atomically.
     \param[in] file_name the name of the file in which the definitions are
     written.
     \note The functions are omitted.
-    \warning If the output file already exists, it is cleared.
+    \warning If the output file already exists, it is replaced.
   */
   void Ops::WriteLuaDefinition(std::string file_name)
   {
-    std::ofstream f(file_name.c_str());
-    f << LuaDefinition();
-    if (!f.good())
-      throw Error("WriteLuaDefinition",
-                  "Failed to write in \"" + file_name + "\".");
-    f.close();
+    GetReadEntries()->WriteLuaDefinition(file_name);
   }
 
 
-  ///////////////////////
-  // PROTECTED METHODS //
-  ///////////////////////
-
-
-  //! Converts an element of the stack to a reference to a single bit.
-  /*! This is method is needed because a reference to an element of
-    'std::vector<bool>' is not a reference to a Boolean but to a single bit.
+  //! Writes the Lua definitions of all read variables in the background.
+  /*! The definitions of the variables read so far are generated and written
+    by another thread, as in 'WriteLuaDefinition'. The variables are not
+    copied: they are shared with the thread, and only copied when they are
+    read again by this object. Hence this object may be used, or destroyed,
+    while the file is being written.
+    \param[in] file_name the name of the file in which the definitions are
+    written.
+    \return A future that becomes ready once the file is written. Its value
+    is the error message, or an empty string if the file was written. No
+    exception is raised by the thread, so that the caller decides where to
+    report the failure, also when 'Error' aborts (OPS_WITH_ABORT).
+    \note The functions are omitted.
+    \warning If the output file already exists, it is replaced.
+  */
+  std::future<std::string>
+  Ops::WriteLuaDefinitionAsync(std::string file_name)
+  {
+    std::shared_ptr<const ReadEntries> entries = GetReadEntries();
+    return std::async(std::launch::async,
+                      &ReadEntries::TryWriteLuaDefinition, entries, file_name);
+  }
+
+
+  //! Enables or disables the report of the phases of 'Open'.
+  /*!
+    \param[in] enable should the next calls to 'Open' and 'Reload' record
+    their phases?
+  */
+  void Ops::EnableOpenReport(bool enable)
+  {
+    record_open_report_ = enable;
+  }
+
+
+  //! Returns the report of the phases of the last call to 'Open'.
+  /*! The report is recorded only if 'EnableOpenReport' was called before
+    'Open' or 'Reload'. It gives the wall time and the memory used by Lua for
+    closing the previous state, creating the new state ('luaL_newstate',
+    'luaL_openlibs', definition of 'ops_in' and of the table 'ops'), loading
+    (parsing) and calling (executing) the configuration file and the files it
+    runs with 'dofile' (as sub-phases), and a full garbage collection.
+    \return The report. Use 'PhaseReport::Str' to print it or
+    'PhaseReport::Json' to export it.
+  */
+  const PhaseReport& Ops::OpenReport() const
+  {
+    return open_report_;
+  }
+
+
+  //! Starts the sampling profiler of the Lua code.
+  /*! Every \a period Lua instructions, the Lua call stack is recorded. The
+    samples are attributed to the configuration file during 'Open' and
+    'Reload', to the function called by 'Apply' or 'ApplyArray', or to the
+    entry whose constraint is checked. The profiler remains active in the
+    new Lua states opened by 'Open'. The samples are available through
+    'GetProfiler': see 'Profiler::Folded' (folded stacks, for flame graphs)
+    and 'Profiler::Str' (samples per line).
+    \param[in] period number of Lua instructions between two samples.
+  */
+  void Ops::StartProfiler(int period)
+  {
+    profiler_.Start(period);
+    if (state_ != NULL)
+      profiler_.Attach(state_);
+  }
+
+
+  //! Stops the sampling profiler.
+  /*! The samples are kept.
+   */
+  void Ops::StopProfiler()
+  {
+    profiler_.Stop();
+    if (state_ != NULL)
+      profiler_.Attach(state_);
+  }
+
+
+  //! Returns the sampling profiler.
+  /*!
+    \return The profiler, with the samples recorded so far.
+  */
+  Profiler& Ops::GetProfiler()
+  {
+    return profiler_;
+  }
+
+
+  //! Returns the journal of the overridden entries.
+  /*!
+    \return The journal.
+  */
+  Journal& Ops::GetJournal()
+  {
+    return *journal_;
+  }
+
+
+  //! Returns the pool of Lua states used by 'ApplyAsync'.
+  /*!
+    \return The pool.
+    \note An exception is raised if the pool is not started.
+  */
+  ApplyPool& Ops::GetApplyPool()
+  {
+    if (!apply_pool_)
+      throw Error("GetApplyPool", "The pool of Lua states is not started. "
+                  "Call 'StartApplyPool' first.");
+    return *apply_pool_;
+  }
+
+
+  //! Sets the access mode to the entries.
+  /*! By default, the entries are read with their metamethods: a table whose
+    metatable has an '__index' table inherits the entries of this table
+    (e.g., with 'setmetatable(child, {__index = parent})'), also in
+    'GetEntryList' and in the vectors. In raw mode, the metatables are
+    ignored ('lua_rawget'), which is faster for the configurations without
+    metatables.
+    \param[in] raw_access true for the raw mode, false for the default mode.
+  */
+  void Ops::SetRawAccess(bool raw_access)
+  {
+    raw_access_ = raw_access;
+  }
+
+
+  //! Are the entries read without metamethods?
+  /*!
+    \return True in raw mode, false otherwise.
+  */
+  bool Ops::GetRawAccess() const
+  {
+    return raw_access_;
+  }
+
+
+  //! Sets the validation mode of the constraints.
+  /*! By default, the constraint of an entry is checked when the entry is
+    read ('Get', 'Set'), and an exception is raised if it is not satisfied.
+    In deferred mode, the entry and its constraint are recorded, and the
+    constraints are checked later, in bulk, by 'Validate' or 'ValidateAsync'
+    at a point chosen by the application. 'Close' (and hence 'Open' and
+    'Deserialize') checks the constraints that are not checked yet, with
+    'Validate'; the destructor discards them.
+    \note A constraint is checked on the value of the entry when 'Validate'
+    is called (or when 'ValidateAsync' takes its snapshot), not on the value
+    returned when the entry was read. If the entry is modified in between
+    (e.g., with 'Override', 'DoString' or a Lua function), the new value is
+    checked.
+    \param[in] deferred true for the deferred mode, false for the default
+    mode.
+  */
+  void Ops::SetDeferredValidation(bool deferred)
+  {
+    deferred_validation_ = deferred;
+  }
+
+
+  //! Are the constraints checked by 'Validate' instead of on read?
+  /*!
+    \return True in deferred mode, false otherwise.
+  */
+  bool Ops::GetDeferredValidation() const
+  {
+    return deferred_validation_;
+  }
+
+
+  //! Discards the tables flattened for inheritance.
+  /*! The flattened tables, with their inherited entries, are computed once
+    and reused until the configuration is run again ('Open', 'DoFile',
+    'DoString'). This method should be called if the tables are modified
+    otherwise, e.g., by a function called with 'Apply'.
+  */
+  void Ops::ClearInheritanceCache()
+  {
+    if (state_ == NULL)
+      return;
+    lua_pushlightuserdata(state_, &inheritance_cache_key_);
+    lua_pushnil(state_);
+    lua_rawset(state_, LUA_REGISTRYINDEX);
+  }
+
+
+  ///////////////////////
+  // PROTECTED METHODS //
+  ///////////////////////
+
+
+  //! Opens a new configuration file, without raising an exception.
+  /*! See 'Open'. The errors are reported with the status code of Lua, so
+    that the callers that must not abort (e.g., the C interface) can handle
+    them.
+    \param[in] file_path path to the configuration file.
+    \param[in] close_state should the Lua state be closed?
+    \return 0 on success, or the status code of Lua, in which case the error
+    message is on top of the stack.
+  */
+  int Ops::TryOpen(std::string file_path, bool close_state)
+  {
+    OPS_INSTRUMENT(instrument_open, file_path);
+    ProfilerContext profiler_context(profiler_, "Open", file_path);
+
+    open_phase_.clear();
+    if (record_open_report_)
+      {
+        open_report_ = PhaseReport("Open " + file_path);
+        open_report_.Begin(LuaMemory());
+        open_phase_.push_back(&open_report_);
+      }
+
+    if (close_state)
+      {
+        BeginPhase("Close");
+        Close();
+        EndPhase();
+        NewState();
+      }
+
+    if (record_open_report_)
+      {
+        // The nested files are recorded as well.
+        lua_pushlightuserdata(state_, this);
+        lua_pushcclosure(state_, DoFileReport, 1);
+        lua_setglobal(state_, "dofile");
+      }
+
+    ClearPrefix();
+    ClearInheritanceCache();
+    file_path_ = file_path;
+    BeginPhase("load", file_path_);
+    int status = luaL_loadfile(state_, file_path_.c_str());
+    EndPhase();
+    if (status == 0)
+      {
+        BeginPhase("call", file_path_);
+        status = lua_pcall(state_, 0, LUA_MULTRET, 0);
+        EndPhase();
+      }
+    if (status != 0)
+      {
+        while (!open_phase_.empty())
+          EndPhase();
+        return status;
+      }
+
+    if (record_open_report_)
+      {
+        BeginPhase("lua_gc");
+        lua_gc(state_, LUA_GCCOLLECT, 0);
+        EndPhase();
+        EndPhase();
+      }
+    return 0;
+  }
+
+
+  //! Converts an element of the stack to a reference to a single bit.
+  /*! This is method is needed because a reference to an element of
+    'std::vector<bool>' is not a reference to a Boolean but to a single bit.
     \param[in] index index in the stack.
     \param[out] output converted value.
     \param[in] name name of the entry.
@@ -804,6 +1470,8 @@ namespace Ops
   bool Ops::Convert(int index, std::vector<bool>::reference output,
                     std::string name)
   {
+    OPS_INSTRUMENT(instrument_convert, name);
+
     if (!lua_isboolean(state_, index))
     {
       if (name.empty())
@@ -830,6 +1498,8 @@ namespace Ops
   */
   bool Ops::Convert(int index, bool& output, std::string name)
   {
+    OPS_INSTRUMENT(instrument_convert, name);
+
     if (!lua_isboolean(state_, index))
     {
       if (name.empty())
@@ -856,6 +1526,8 @@ namespace Ops
   */
   bool Ops::Convert(int index, int& output, std::string name)
   {
+    OPS_INSTRUMENT(instrument_convert, name);
+
     if (!lua_isnumber(state_, index))
     {
       if (name.empty())
@@ -892,6 +1564,8 @@ namespace Ops
   */
   bool Ops::Convert(int index, float& output, std::string name)
   {
+    OPS_INSTRUMENT(instrument_convert, name);
+
     if (!lua_isnumber(state_, index))
     {
       if (name.empty())
@@ -918,6 +1592,8 @@ namespace Ops
   */
   bool Ops::Convert(int index, double& output, std::string name)
   {
+    OPS_INSTRUMENT(instrument_convert, name);
+
     if (!lua_isnumber(state_, index))
     {
       if (name.empty())
@@ -944,6 +1620,8 @@ namespace Ops
   */
   bool Ops::Convert(int index, std::string& output, std::string name)
   {
+    OPS_INSTRUMENT(instrument_convert, name);
+
     if (!lua_isstring(state_, index))
     {
       if (name.empty())
@@ -1007,6 +1685,93 @@ namespace Ops
   }
 
 
+  //! Records a constraint to be checked by 'Validate', in deferred mode.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] constraint the constraint to be satisfied.
+    \return True if the constraint is recorded, false if it should be
+    checked now (default mode, or empty constraint).
+    \note The prefix is prepended to \a name.
+  */
+  bool Ops::DeferConstraint(const std::string& name,
+                            const std::string& constraint)
+  {
+    if (!deferred_validation_ || constraint.empty())
+      return false;
+    std::lock_guard<std::mutex> lock(deferred_mutex_);
+    deferred_constraint_.push_back(std::make_pair(Name(name), constraint));
+    return true;
+  }
+
+
+  //! Checks constraints in bulk.
+  /*! Every constraint is compiled once, into a Lua function of 'v', which is
+    then called with the value of each entry.
+    \param[in] constraint the names (with the prefix) of the entries and
+    their constraints.
+    \return The descriptions of the constraints that are not satisfied, or
+    that could not be checked.
+  */
+  std::vector<std::string>
+  Ops::CheckConstraints(const std::vector<std::pair<std::string,
+                        std::string> >& constraint)
+  {
+    std::vector<std::string> failure;
+    // The compiled constraints, indexed by their code.
+    lua_newtable(state_);
+    int compiled = lua_gettop(state_);
+    for (std::size_t i = 0; i < constraint.size(); i++)
+      {
+        const std::string& name = constraint[i].first;
+        const std::string& code = constraint[i].second;
+        std::string entry = "entry \"" + name + "\" in \"" + file_path_
+          + "\"";
+        OPS_INSTRUMENT(instrument_constraint, name);
+        ProfilerContext profiler_context(profiler_, "Constraint", name);
+
+        lua_getfield(state_, compiled, code.c_str());
+        if (lua_isnil(state_, -1))
+          {
+            lua_pop(state_, 1);
+            std::string function = "return function(v)\nreturn " + code
+              + "\nend";
+            if (luaL_loadstring(state_, function.c_str()) != 0
+                || lua_pcall(state_, 0, 1, 0) != 0)
+              {
+                failure.push_back("While checking " + entry + ":\n  "
+                                  + std::string(lua_tostring(state_, -1)));
+                lua_settop(state_, compiled);
+                continue;
+              }
+            lua_pushvalue(state_, -1);
+            lua_setfield(state_, compiled, code.c_str());
+          }
+
+        // 'PutOnStack' may leave intermediate tables below the value.
+        int function = lua_gettop(state_);
+        PutOnStack(name);
+        if (lua_gettop(state_) > function + 1)
+          {
+            lua_replace(state_, function + 1);
+            lua_settop(state_, function + 1);
+          }
+        if (lua_pcall(state_, 1, 1, 0) != 0)
+          failure.push_back("While checking " + entry + ":\n  "
+                            + std::string(lua_tostring(state_, -1)));
+        else if (!lua_isboolean(state_, -1))
+          failure.push_back("For " + entry + ", the following constraint "
+                            "did not return a Boolean:\n"
+                            + Constraint(code));
+        else if (!lua_toboolean(state_, -1))
+          failure.push_back("The " + entry + " does not satisfy the "
+                            "constraint:\n" + Constraint(code));
+        lua_settop(state_, compiled);
+      }
+    lua_settop(state_, compiled - 1);
+    return failure;
+  }
+
+
   //! Iterates over the elements of \a name to put it on stack.
   /*! For instance, if "table.subtable.subsubtable[2]" is to be accessed, one
     should put "table" on top of the stack and call
@@ -1027,16 +1792,14 @@ namespace Ops
     if (end == std::string::npos)
       // No more sub-entry here.
       {
-        lua_pushstring(state_, name.c_str());
-        lua_gettable(state_, -2);
+        GetField(name);
         return;
       }
 
     if (name[end] == '.')
       // One step down.
       {
-        lua_pushstring(state_, name.substr(0, end).c_str());
-        lua_gettable(state_, -2);
+        GetField(name.substr(0, end));
         WalkDown(name.substr(end + 1).c_str());
         return;
       }
@@ -1071,8 +1834,14 @@ namespace Ops
           std::istringstream str(index_str);
           int index;
           str >> index;
-          // Now getting the element of index 'index'.
+          // Now getting the element of index 'index', possibly inherited.
+          Flatten();
           lua_rawgeti(state_, -1, index);
+          if (ForceThunk())
+            {
+              lua_pushvalue(state_, -1);
+              lua_rawseti(state_, -3, index);
+            }
           // And preparing for the next step down.
           std::string next_name = name.substr(end_index + 1).c_str();
           if (!next_name.empty() && next_name[0] == '.')
@@ -1085,8 +1854,7 @@ namespace Ops
         // One step down before addressing "[i]" in the next call to
         // 'WalkDown'.
         {
-          lua_pushstring(state_, name.substr(0, end).c_str());
-          lua_gettable(state_, -2);
+          GetField(name.substr(0, end));
           if (name[end] == '.')
             WalkDown(name.substr(end + 1).c_str());
           else
@@ -1097,6 +1865,1043 @@ namespace Ops
   }
 
 
+  //! Puts the field \a key of the table on top of the stack on the stack.
+  /*! In the default mode, inherited fields are found through the flattened
+    table (see 'Flatten') and the other metamethods are honoured. In raw mode,
+    the metatables are ignored, except that a lazy table is loaded (see
+    'LoadLazy'), and nil is pushed if the element on top of the stack is not a
+    table. If the field is a thunk (see 'ForceThunk'), it is
+    evaluated and replaced with its value in the table that defines it (the
+    table itself or a table it inherits from) and in the flattened table.
+    \param[in] key the key of the field.
+  */
+  void Ops::GetField(const std::string& key)
+  {
+    if (raw_access_)
+      {
+        LoadLazy();
+        if (!lua_istable(state_, -1))
+          lua_pushnil(state_);
+        else
+          {
+            lua_pushlstring(state_, key.data(), key.size());
+            lua_rawget(state_, -2);
+          }
+        if (ForceThunk())
+          {
+            // The thunk is replaced with its value in the table.
+            lua_pushlstring(state_, key.data(), key.size());
+            lua_pushvalue(state_, -2);
+            lua_rawset(state_, -4);
+          }
+        return;
+      }
+
+    // The table is kept below its flattened copy, which only caches its
+    // entries.
+    LoadLazy();
+    lua_pushvalue(state_, -1);
+    Flatten();
+    lua_pushlstring(state_, key.data(), key.size());
+    lua_gettable(state_, -2);
+    if (ForceThunk() && lua_istable(state_, -2))
+      {
+        lua_pushlstring(state_, key.data(), key.size());
+        lua_pushvalue(state_, -2);
+        lua_rawset(state_, -4);
+
+        // Searches the '__index' chain for the table that defines the field.
+        lua_pushvalue(state_, -3);
+        for (int depth = 0; depth < 100 && lua_istable(state_, -1); depth++)
+          {
+            lua_pushlstring(state_, key.data(), key.size());
+            lua_rawget(state_, -2);
+            bool owner = !lua_isnil(state_, -1);
+            lua_pop(state_, 1);
+            if (owner)
+              {
+                lua_pushlstring(state_, key.data(), key.size());
+                lua_pushvalue(state_, -3);
+                lua_rawset(state_, -3);
+                break;
+              }
+            if (!lua_getmetatable(state_, -1))
+              break;
+            lua_pushstring(state_, "__index");
+            lua_rawget(state_, -2);
+            lua_remove(state_, -2);
+            lua_remove(state_, -2);
+          }
+        lua_pop(state_, 1);
+      }
+    lua_remove(state_, -3);
+  }
+
+
+  //! Replaces the table on top of the stack with its flattened version.
+  /*! If the table inherits from a table through the '__index' field of its
+    metatable, possibly along a chain of such tables, it is replaced with a
+    table without metatable that contains its entries and all inherited
+    entries. The flattened tables are memoized in the Lua registry, so that
+    the tables of a chain are flattened once, even if they are shared by
+    several tables. Nothing is done in raw mode, if the element on top of the
+    stack is not a table, or if the chain contains an '__index' which is not
+    a table (e.g., a function). A lazy table is loaded first (see
+    'LoadLazy'), even in raw mode.
+    \param[in] depth the number of tables already followed in the chain.
+    \return False if the chain contains an '__index' which is not a table,
+    true otherwise.
+  */
+  bool Ops::Flatten(int depth)
+  {
+    LoadLazy();
+    if (raw_access_ || !lua_istable(state_, -1)
+        || !lua_getmetatable(state_, -1))
+      return true;
+
+    if (!lua_checkstack(state_, 8))
+      throw Error("Flatten", "Lua stack overflow while following an "
+                  "'__index' chain.");
+
+    int table = lua_gettop(state_) - 1;
+    lua_pushstring(state_, "__index");
+    lua_rawget(state_, -2);
+    lua_remove(state_, -2);
+    if (lua_isnil(state_, -1))
+      {
+        lua_pop(state_, 1);
+        return true;
+      }
+    if (!lua_istable(state_, -1))
+      {
+        lua_pop(state_, 1);
+        return false;
+      }
+    // Lua itself gives up after 100 steps.
+    if (depth == 100)
+      throw Error("Flatten", "There is a loop, or more than 100 tables, in "
+                  "an '__index' chain.");
+
+    // Was the table already flattened?
+    lua_pushlightuserdata(state_, &inheritance_cache_key_);
+    lua_rawget(state_, LUA_REGISTRYINDEX);
+    if (lua_isnil(state_, -1))
+      {
+        lua_pop(state_, 1);
+        // The cache does not keep the tables alive.
+        lua_newtable(state_);
+        lua_newtable(state_);
+        lua_pushstring(state_, "k");
+        lua_setfield(state_, -2, "__mode");
+        lua_setmetatable(state_, -2);
+        lua_pushlightuserdata(state_, &inheritance_cache_key_);
+        lua_pushvalue(state_, -2);
+        lua_rawset(state_, LUA_REGISTRYINDEX);
+      }
+    int cache = lua_gettop(state_);
+    lua_pushvalue(state_, table);
+    lua_rawget(state_, cache);
+    if (!lua_isnil(state_, -1))
+      {
+        bool flat = lua_istable(state_, -1);
+        if (flat)
+          lua_replace(state_, table);
+        lua_settop(state_, table);
+        return flat;
+      }
+    lua_pop(state_, 1);
+
+    // Flattens the parent table, then overrides its entries.
+    lua_pushvalue(state_, cache - 1);
+    if (!Flatten(depth + 1))
+      {
+        lua_pushvalue(state_, table);
+        lua_pushboolean(state_, 0);
+        lua_rawset(state_, cache);
+        lua_settop(state_, table);
+        return false;
+      }
+    int parent = lua_gettop(state_);
+    lua_newtable(state_);
+    int flattened = lua_gettop(state_);
+    int source[2] = {parent, table};
+    for (int i = 0; i < 2; i++)
+      {
+        lua_pushnil(state_);
+        while (lua_next(state_, source[i]) != 0)
+          {
+            lua_pushvalue(state_, -2);
+            lua_insert(state_, -2);
+            lua_rawset(state_, flattened);
+          }
+      }
+
+    lua_pushvalue(state_, table);
+    lua_pushvalue(state_, flattened);
+    lua_rawset(state_, cache);
+    lua_replace(state_, table);
+    lua_settop(state_, table);
+    return true;
+  }
+
+
+  //! Loads the lazy table on top of the stack, if it is one.
+  /*! A lazy table is a placeholder defined by 'ops.lazy' in Lua. On its first
+    access, its file is run. The placeholder is then replaced, on the stack
+    and in its parent table, with the table defined by the file.
+  */
+  void Ops::LoadLazy()
+  {
+    if (!lua_istable(state_, -1) || !lua_getmetatable(state_, -1))
+      return;
+    lua_pushstring(state_, "__ops_lazy");
+    lua_rawget(state_, -2);
+    lua_remove(state_, -2);
+    if (!lua_isfunction(state_, -1))
+      {
+        lua_pop(state_, 1);
+        return;
+      }
+    if (lua_pcall(state_, 0, 1, 0) != 0)
+      throw Error("LoadLazy", lua_tostring(state_, -1));
+    lua_replace(state_, -2);
+  }
+
+
+  //! Checks whether a value of the stack is a thunk.
+  /*! A thunk is defined by 'ops.thunk' in Lua. No Lua code is run.
+    \param[in] index index of the value in the stack.
+    \return True if the value is a thunk, false otherwise.
+  */
+  bool Ops::IsThunk(int index)
+  {
+    if (!lua_istable(state_, index) || !lua_getmetatable(state_, index))
+      return false;
+    lua_pushstring(state_, "__ops_thunk");
+    lua_rawget(state_, -2);
+    bool thunk = lua_isfunction(state_, -1);
+    lua_pop(state_, 2);
+    return thunk;
+  }
+
+
+  //! Evaluates the thunk on top of the stack, if it is one.
+  /*! A thunk is defined by 'ops.thunk' in Lua. Its function is called on the
+    first evaluation only, and the thunk is replaced on the stack with the
+    result. If the result is a thunk, it is evaluated as well.
+    \return True if the element on top of the stack was a thunk, false
+    otherwise.
+  */
+  bool Ops::ForceThunk()
+  {
+    bool thunk = false;
+    while (lua_istable(state_, -1) && lua_getmetatable(state_, -1))
+      {
+        lua_pushstring(state_, "__ops_thunk");
+        lua_rawget(state_, -2);
+        lua_remove(state_, -2);
+        if (!lua_isfunction(state_, -1))
+          {
+            lua_pop(state_, 1);
+            break;
+          }
+        if (lua_pcall(state_, 0, 1, 0) != 0)
+          throw Error("ForceThunk", lua_tostring(state_, -1));
+        lua_replace(state_, -2);
+        thunk = true;
+      }
+    return thunk;
+  }
+
+
+  //! Assigns the value on top of the stack to an entry.
+  /*! The value is popped from the stack.
+    \param[in] name the name of the entry. The table that contains the entry
+    must exist.
+    \param[in] journal should the assignment be appended to the journal, if
+    a journal is open?
+    \note The prefix is not prepended to \a name.
+  */
+  void Ops::Assign(std::string name, bool journal)
+  {
+    int value = lua_gettop(state_);
+
+    std::size_t end = name.find_last_of(".[");
+    std::string parent = end == std::string::npos ? "" : name.substr(0, end);
+    PutOnStack(parent);
+    LoadLazy();
+    if (!lua_istable(state_, -1))
+      throw Error("Assign", "Unable to assign \"" + name + "\": \"" + parent
+                  + "\" is not a table.");
+
+    if (end == std::string::npos)
+      lua_pushlstring(state_, name.data(), name.size());
+    else if (name[end] == '.' && end + 1 < name.size())
+      lua_pushstring(state_, name.substr(end + 1).c_str());
+    else
+      {
+        // "[i]" at the end of the name.
+        std::string index = name.substr(end + 1);
+        if (index.size() < 2 || index[index.size() - 1] != ']'
+            || index.find_first_not_of("0123456789") != index.size() - 1)
+          throw Error("Assign", "Unable to assign \"" + name + "\": wrong "
+                      "syntax.");
+        std::istringstream str(index.substr(0, index.size() - 1));
+        int i;
+        str >> i;
+        lua_pushnumber(state_, static_cast<lua_Number>(i));
+      }
+    lua_pushvalue(state_, value);
+    if (raw_access_)
+      lua_rawset(state_, -3);
+    else
+      lua_settable(state_, -3);
+    ClearInheritanceCache();
+
+    if (journal && journal_->IsOpen())
+      {
+        std::string buffer;
+        SnapshotWriter writer;
+        SerializeValue(value, buffer, writer);
+        journal_->Append(name, buffer);
+      }
+
+    lua_settop(state_, value - 1);
+  }
+
+
+  //! Opens a new Lua state.
+  /*! The standard Lua libraries are loaded, 'ops_in' is defined and the
+    module 'ops' is made available to 'require' (see 'LoadOpsModule'). The
+    previous state, if any, should have been closed.
+  */
+  void Ops::NewState()
+  {
+    BeginPhase("luaL_newstate");
+    state_ = luaL_newstate();
+    EndPhase();
+    BeginPhase("luaL_openlibs");
+    luaL_openlibs(state_);
+    EndPhase();
+
+    // Defines 'ops_in' for the user. It checks whether an element is in a
+    // table.
+    std::string code = "function ops_in(v, table)\
+    for _, value in ipairs(table) do        \
+        if v == value then                  \
+            return true                     \
+        end                                 \
+    end                                     \
+    return false                            \
+    end";
+    BeginPhase("ops_in");
+    if (luaL_dostring(state_, code.c_str()))
+      throw Error("NewState()", lua_tostring(state_, -1));
+    EndPhase();
+
+    // The module 'ops' is only compiled if it is required.
+    lua_getglobal(state_, "package");
+    lua_getfield(state_, -1, "preload");
+    lua_pushcfunction(state_, LoadOpsModule);
+    lua_setfield(state_, -2, "ops");
+    lua_pop(state_, 2);
+
+    if (profiler_.IsActive())
+      profiler_.Attach(state_);
+  }
+
+
+  //! Starts a phase of the report of 'Open'.
+  /*! Nothing is done if no report is being recorded.
+    \param[in] phase name of the phase.
+    \param[in] name name of the file, if any.
+  */
+  void Ops::BeginPhase(std::string phase, const std::string& name)
+  {
+    if (open_phase_.empty())
+      return;
+    if (!name.empty())
+      phase += " " + name;
+    PhaseReport& report = open_phase_.back()->AddChild(phase);
+    report.Begin(LuaMemory());
+    open_phase_.push_back(&report);
+  }
+
+
+  //! Ends the current phase of the report of 'Open'.
+  /*! Nothing is done if no report is being recorded.
+   */
+  void Ops::EndPhase()
+  {
+    if (open_phase_.empty())
+      return;
+    open_phase_.back()->End(LuaMemory());
+    open_phase_.pop_back();
+  }
+
+
+  //! Returns the memory used by Lua.
+  /*!
+    \return The memory used by Lua in bytes, or 0 if no state is open.
+  */
+  long Ops::LuaMemory() const
+  {
+    if (state_ == NULL)
+      return 0;
+    return 1024L * lua_gc(state_, LUA_GCCOUNT, 0)
+      + lua_gc(state_, LUA_GCCOUNTB, 0);
+  }
+
+
+  //! Replaces 'dofile' in Lua while 'Open' records its report.
+  /*! It runs a file like 'dofile', but it records the loading and the call
+    of the file as phases of the report. The 'Ops' object is the first
+    upvalue.
+    \param[in] state the Lua state.
+    \return The number of values returned by the file.
+  */
+  int Ops::DoFileReport(lua_State* state)
+  {
+    Ops* ops = static_cast<Ops*>(lua_touserdata(state, lua_upvalueindex(1)));
+    const char* file_path = luaL_optstring(state, 1, NULL);
+    lua_settop(state, 1);
+
+    int status;
+    {
+      // No C++ object may be alive when 'lua_error' is called.
+      std::string name = file_path == NULL ? "stdin" : file_path;
+      ops->BeginPhase("load", name);
+      status = luaL_loadfile(state, file_path);
+      ops->EndPhase();
+      if (status == 0)
+        {
+          ops->BeginPhase("call", name);
+          status = lua_pcall(state, 0, LUA_MULTRET, 0);
+          ops->EndPhase();
+        }
+    }
+    if (status != 0)
+      return lua_error(state);
+    return lua_gettop(state) - 1;
+  }
+
+
+  //! Loads the module 'ops', on 'require "ops"' in Lua.
+  /*! The module is a table of Lua functions.
+    'ops.lazy(name, file_path)' defines a placeholder for the table 'name',
+    whose file is run on the first access to the table (see 'LoadLazy'). The
+    file may return the table or define it. 'ops.load_all' loads the
+    placeholders that are still in place. 'ops.thunk(f)' defines a value
+    computed by 'f' on its first read from C++ (see 'ForceThunk') or through
+    'ops.force'. The function 'load_all' is also stored in the registry, for
+    'Serialize'.
+    \param[in] state the Lua state.
+    \return 1: the module is returned.
+  */
+  int Ops::LoadOpsModule(lua_State* state)
+  {
+    static const char* code =
+      "local ops = {pending = setmetatable({}, {__mode = 'k'})}\n"
+      "function ops.lazy(name, file_path)\n"
+      "  local parent, key = _G, name\n"
+      "  local dot = string.find(key, '.', 1, true)\n"
+      "  while dot do\n"
+      "    parent = parent[string.sub(key, 1, dot - 1)]\n"
+      "    key = string.sub(key, dot + 1)\n"
+      "    if type(parent) ~= 'table' then\n"
+      "      error('ops.lazy: the parent of \"' .. name .. '\" is not a "
+      "table.', 2)\n"
+      "    end\n"
+      "    dot = string.find(key, '.', 1, true)\n"
+      "  end\n"
+      "  local placeholder, value, loading = {}, nil, false\n"
+      "  local function load(installed)\n"
+      "    if installed and rawget(parent, key) ~= placeholder then\n"
+      "      ops.pending[placeholder] = nil\n"
+      "    elseif value == nil and not loading then\n"
+      "      loading = true\n"
+      "      local success, result = pcall(dofile, file_path)\n"
+      "      loading = false\n"
+      "      if not success then error(result, 0) end\n"
+      "      if type(result) ~= 'table' then result = rawget(parent, key) end\n"
+      "      if type(result) ~= 'table' then\n"
+      "        error('ops.lazy: \"' .. file_path .. '\" does not define the "
+      "table \"' .. name .. '\".', 0)\n"
+      "      end\n"
+      "      value = result\n"
+      "      ops.pending[placeholder] = nil\n"
+      "      if rawget(parent, key) == placeholder then\n"
+      "        rawset(parent, key, value)\n"
+      "      end\n"
+      "      if value == placeholder then\n"
+      "        setmetatable(placeholder, nil)\n"
+      "      else\n"
+      "        setmetatable(placeholder, {__index = value, __newindex = value,\n"
+      "          __len = function() return #value end,\n"
+      "          __pairs = function() return next, value, nil end,\n"
+      "          __ops_lazy = load})\n"
+      "      end\n"
+      "    end\n"
+      "    return value\n"
+      "  end\n"
+      "  setmetatable(placeholder, {\n"
+      "    __index = function(_, k) local t = load() if t then return t[k] "
+      "end end,\n"
+      "    __newindex = function(_, k, v) local t = load()\n"
+      "      if t then t[k] = v else rawset(placeholder, k, v) end end,\n"
+      "    __len = function() return #(load() or {}) end,\n"
+      "    __pairs = function() return next, load() or {}, nil end,\n"
+      "    __ops_lazy = load})\n"
+      "  ops.pending[placeholder] = load\n"
+      "  rawset(parent, key, placeholder)\n"
+      "end\n"
+      "function ops.thunk(f)\n"
+      "  if type(f) ~= 'function' then\n"
+      "    error('ops.thunk: a function is expected.', 2)\n"
+      "  end\n"
+      "  local value, evaluated = nil, false\n"
+      "  local function evaluate()\n"
+      "    if not evaluated then\n"
+      "      value = f()\n"
+      "      evaluated, f = true, nil\n"
+      "    end\n"
+      "    return value\n"
+      "  end\n"
+      "  return setmetatable({}, {__ops_thunk = evaluate})\n"
+      "end\n"
+      "function ops.force(v)\n"
+      "  local metatable = type(v) == 'table' and getmetatable(v)\n"
+      "  while metatable and rawget(metatable, '__ops_thunk') do\n"
+      "    v = metatable.__ops_thunk()\n"
+      "    metatable = type(v) == 'table' and getmetatable(v)\n"
+      "  end\n"
+      "  return v\n"
+      "end\n"
+      "function ops.load_all()\n"
+      "  local pending = next(ops.pending)\n"
+      "  while pending do\n"
+      "    ops.pending[pending](true)\n"
+      "    pending = next(ops.pending)\n"
+      "  end\n"
+      "end\n"
+      "return ops";
+    if (luaL_loadbuffer(state, code, std::strlen(code), "=ops") != 0)
+      return lua_error(state);
+    lua_call(state, 0, 1);
+
+    lua_pushlightuserdata(state, &ops_module_key_);
+    lua_getfield(state, -2, "load_all");
+    lua_rawset(state, LUA_REGISTRYINDEX);
+    return 1;
+  }
+
+
+  //! Checks whether a value of the stack can be serialized.
+  /*!
+    \param[in] index index in the stack.
+    \param[in] writer the state of the serialization.
+    \return True if the value is a Boolean, a number, a string, a table, a
+    Lua function or an object of the standard libraries, false otherwise.
+  */
+  bool Ops::IsSerializable(int index, const SnapshotWriter& writer) const
+  {
+    int type = lua_type(state_, index);
+    if (type == LUA_TBOOLEAN || type == LUA_TNUMBER || type == LUA_TSTRING
+        || type == LUA_TTABLE)
+      return true;
+    if (type == LUA_TFUNCTION && !lua_iscfunction(state_, index))
+      return true;
+    return writer.library.count(lua_topointer(state_, index)) != 0;
+  }
+
+
+  //! Names the objects of the standard libraries.
+  /*! The tables of the libraries are named after the libraries (e.g.,
+    "string"), and their C functions and userdata after the library and the
+    field (e.g., "string.format" or "io.stdout"). Such objects are serialized
+    by name. The names are those of a new Lua state, so that an alias (e.g.,
+    'out = print') is not taken for the original.
+    \param[in,out] writer the state of the serialization.
+  */
+  void Ops::IndexLibrary(SnapshotWriter& writer)
+  {
+    const char* library[] = {"_G", "coroutine", "package", "string", "table",
+                             "math", "io", "os", "debug", "bit32", "utf8",
+                             NULL};
+    lua_State* reference = luaL_newstate();
+    if (reference == NULL)
+      throw Error("IndexLibrary", "Unable to create a Lua state.");
+    luaL_openlibs(reference);
+    lua_getfield(reference, LUA_REGISTRYINDEX, "_LOADED");
+    lua_getfield(state_, LUA_REGISTRYINDEX, "_LOADED");
+    int loaded = lua_gettop(state_);
+    for (int i = 0; library[i] != NULL; i++)
+      {
+        lua_getfield(reference, -1, library[i]);
+        lua_getfield(state_, loaded, library[i]);
+        if (lua_istable(reference, -1) && lua_istable(state_, -1))
+          {
+            writer.library[lua_topointer(state_, -1)] = library[i];
+            lua_pushnil(reference);
+            while (lua_next(reference, -2) != 0)
+              {
+                if (lua_type(reference, -2) == LUA_TSTRING
+                    && (lua_iscfunction(reference, -1)
+                        || lua_isuserdata(reference, -1)))
+                  {
+                    std::string field = lua_tostring(reference, -2);
+                    lua_getfield(state_, -1, field.c_str());
+                    if (lua_iscfunction(state_, -1)
+                        || lua_isuserdata(state_, -1))
+                      writer.library.insert
+                        (std::make_pair(lua_topointer(state_, -1),
+                                        std::string(library[i]) + "."
+                                        + field));
+                    lua_pop(state_, 1);
+                  }
+                lua_pop(reference, 1);
+              }
+          }
+        lua_pop(reference, 1);
+        lua_pop(state_, 1);
+      }
+    lua_close(reference);
+    lua_pop(state_, 1);
+  }
+
+
+  //! Serializes a value of the stack.
+  /*! See 'Serialize' for the format.
+    \param[in] index index of the value in the stack. It should be nil or
+    satisfy 'IsSerializable'.
+    \param[in,out] buffer the buffer to which the value is appended.
+    \param[in,out] writer the state of the serialization.
+    \param[in] skip_library should the entries of the standard Lua libraries
+    be skipped? This is relevant for the global table only.
+  */
+  void Ops::SerializeValue(int index, std::string& buffer,
+                           SnapshotWriter& writer, bool skip_library)
+  {
+    if (index < 0 && index > LUA_REGISTRYINDEX)
+      index = lua_gettop(state_) + index + 1;
+
+    size_t length;
+    const char* characters;
+    switch (lua_type(state_, index))
+      {
+      case LUA_TNIL:
+        buffer += char(snapshot_nil_);
+        return;
+      case LUA_TBOOLEAN:
+        buffer += char(lua_toboolean(state_, index) ? snapshot_true_
+                       : snapshot_false_);
+        return;
+      case LUA_TNUMBER:
+        buffer += char(snapshot_number_);
+        SerializeRaw(static_cast<double>(lua_tonumber(state_, index)), buffer);
+        return;
+      case LUA_TSTRING:
+        characters = lua_tolstring(state_, index, &length);
+        buffer += char(snapshot_string_);
+        SerializeRaw(static_cast<uint32_t>(length), buffer);
+        buffer.append(characters, length);
+        return;
+      }
+
+    const void* table = lua_topointer(state_, index);
+    std::map<const void*, uint64_t>::iterator i = writer.position.find(table);
+    if (i != writer.position.end())
+      {
+        buffer += char(snapshot_reference_);
+        SerializeRaw(i->second, buffer);
+        return;
+      }
+    std::map<const void*, std::string>::iterator j
+      = writer.library.find(table);
+    if (!skip_library && j != writer.library.end())
+      {
+        buffer += char(snapshot_library_);
+        SerializeRaw(static_cast<uint32_t>(j->second.size()), buffer);
+        buffer += j->second;
+        return;
+      }
+    if (lua_type(state_, index) == LUA_TFUNCTION
+        && !lua_iscfunction(state_, index))
+      {
+        SerializeFunction(index, buffer, writer);
+        return;
+      }
+    if (lua_type(state_, index) != LUA_TTABLE)
+      throw Error("SerializeValue", std::string("Unable to serialize a ")
+                  + lua_typename(state_, lua_type(state_, index)) + ".");
+    writer.position[table] = buffer.size();
+
+    if (!lua_checkstack(state_, 8))
+      throw Error("SerializeValue", "The tables are too deeply nested.");
+
+    buffer += char(snapshot_table_);
+    std::size_t header = buffer.size();
+    SerializeRaw(uint32_t(0), buffer);
+    SerializeRaw(uint64_t(0), buffer);
+
+    // The metatables are not serialized: the inherited entries are written
+    // as entries of the table (see 'Flatten'), unless in raw mode.
+    lua_pushvalue(state_, index);
+    if (!raw_access_)
+      Flatten();
+    int entries = lua_gettop(state_);
+
+    // The thunks are evaluated before the traversal, since they may add
+    // fields to the table.
+    bool thunk = true;
+    while (thunk)
+      {
+        thunk = false;
+        lua_newtable(state_);
+        int key_list = lua_gettop(state_);
+        int key_count = 0;
+        lua_pushnil(state_);
+        while (lua_next(state_, entries) != 0)
+          {
+            if (IsThunk(-1))
+              {
+                lua_pushvalue(state_, -2);
+                lua_rawseti(state_, key_list, ++key_count);
+              }
+            lua_pop(state_, 1);
+          }
+        for (int k = 1; k <= key_count; k++)
+          {
+            lua_rawgeti(state_, key_list, k);
+            lua_pushvalue(state_, -1);
+            lua_rawget(state_, entries);
+            ForceThunk();
+            lua_rawset(state_, entries);
+            thunk = true;
+          }
+        lua_settop(state_, entries);
+      }
+
+    if (skip_library)
+      lua_getfield(state_, LUA_REGISTRYINDEX, "_LOADED");
+    int loaded = lua_gettop(state_);
+
+    uint32_t count = 0;
+    lua_pushnil(state_);
+    while (lua_next(state_, entries) != 0)
+      {
+        int key_type = lua_type(state_, -2);
+        bool skip = !IsSerializable(-1, writer) || key_type == LUA_TTABLE
+          || key_type == LUA_TFUNCTION || !IsSerializable(-2, writer);
+        if (!skip && skip_library && key_type == LUA_TSTRING)
+          {
+            // The standard libraries are registered in 'package.loaded'.
+            lua_pushvalue(state_, -2);
+            lua_rawget(state_, loaded);
+            skip = lua_rawequal(state_, -1, -2)
+              || std::string(lua_tostring(state_, -3)) == "_VERSION";
+            lua_pop(state_, 1);
+            // The base functions (e.g., 'print') are defined anyway.
+            std::map<const void*, std::string>::iterator library
+              = writer.library.find(lua_topointer(state_, -1));
+            skip = skip || (library != writer.library.end()
+                            && library->second == "_G." + std::string
+                            (lua_tostring(state_, -2)));
+          }
+        if (!skip)
+          {
+            SerializeValue(-2, buffer, writer);
+            SerializeValue(-1, buffer, writer);
+            count++;
+          }
+        lua_pop(state_, 1);
+      }
+    lua_settop(state_, index);
+
+    uint64_t size = buffer.size() - header - 12;
+    std::memcpy(&buffer[header], &count, sizeof(count));
+    std::memcpy(&buffer[header + 4], &size, sizeof(size));
+  }
+
+
+  //! Serializes a Lua function of the stack, with its upvalues.
+  /*! See 'Serialize' for the format.
+    \param[in] index index of the function in the stack (positive).
+    \param[in,out] buffer the buffer to which the function is appended.
+    \param[in,out] writer the state of the serialization.
+  */
+  void Ops::SerializeFunction(int index, std::string& buffer,
+                              SnapshotWriter& writer)
+  {
+    uint64_t start = buffer.size();
+    writer.position[lua_topointer(state_, index)] = start;
+
+    if (!lua_checkstack(state_, 4))
+      throw Error("SerializeValue", "The functions are too deeply nested.");
+
+    lua_Debug debug;
+    lua_pushvalue(state_, index);
+    lua_getinfo(state_, ">u", &debug);
+    uint32_t count = static_cast<uint32_t>(debug.nups);
+
+    buffer += char(snapshot_function_);
+    SerializeRaw(count, buffer);
+    std::size_t header = buffer.size();
+    SerializeRaw(uint64_t(0), buffer);
+
+    std::string bytecode;
+    lua_pushvalue(state_, index);
+    int status = OPS_LUA_DUMP(state_, DumpFunction, &bytecode);
+    lua_pop(state_, 1);
+    if (status != 0)
+      throw Error("SerializeValue", "Unable to dump a function.");
+    SerializeRaw(static_cast<uint32_t>(bytecode.size()), buffer);
+    buffer += bytecode;
+
+    for (uint32_t i = 1; i <= count; i++)
+      {
+#if LUA_VERSION_NUM > 501
+        // The upvalues shared with a function already serialized are joined.
+        const void* upvalue = lua_upvalueid(state_, index, int(i));
+        std::map<const void*, std::pair<uint64_t, uint32_t> >::iterator j
+          = writer.upvalue.find(upvalue);
+        if (j != writer.upvalue.end())
+          {
+            buffer += char(1);
+            SerializeRaw(j->second.first, buffer);
+            SerializeRaw(j->second.second, buffer);
+            continue;
+          }
+        writer.upvalue[upvalue] = std::make_pair(start, i);
+#endif
+        buffer += char(0);
+        const char* name = lua_getupvalue(state_, index, int(i));
+        if (!lua_isnil(state_, -1) && !IsSerializable(-1, writer))
+          throw Error("SerializeValue", "Unable to serialize the upvalue \""
+                      + std::string(name == NULL ? "" : name) + "\" (a "
+                      + lua_typename(state_, lua_type(state_, -1))
+                      + ") of a function.");
+        SerializeValue(-1, buffer, writer);
+        lua_pop(state_, 1);
+      }
+
+    uint64_t size = buffer.size() - header - 8;
+    std::memcpy(&buffer[header], &size, sizeof(size));
+  }
+
+
+  //! Appends a chunk of bytecode to a buffer.
+  /*! This is the writer given to 'lua_dump'.
+    \param[in] state the Lua state.
+    \param[in] data the chunk.
+    \param[in] size size of the chunk in bytes.
+    \param[in,out] buffer the buffer (a std::string).
+    \return 0.
+  */
+  int Ops::DumpFunction(lua_State* /* state */, const void* data,
+                        size_t size, void* buffer)
+  {
+    static_cast<std::string*>(buffer)->append(static_cast<const char*>(data),
+                                              size);
+    return 0;
+  }
+
+
+  //! Deserializes a value and pushes it onto the stack.
+  /*! See 'Serialize' for the format.
+    \param[in] buffer the buffer.
+    \param[in,out] position position of the value in \a buffer. On exit, it
+    is the position following the value.
+    \param[in] table_index index in the stack of the table that stores the
+    tables and functions already deserialized, indexed by their position in
+    \a buffer.
+  */
+  void Ops::DeserializeValue(const std::string& buffer, std::size_t& position,
+                             int table_index)
+  {
+    std::size_t start = position;
+    unsigned char tag = DeserializeRaw<unsigned char>(buffer, position);
+    uint32_t length;
+    std::string name;
+    int top;
+    switch (tag)
+      {
+      case snapshot_nil_:
+        lua_pushnil(state_);
+        return;
+      case snapshot_false_:
+      case snapshot_true_:
+        lua_pushboolean(state_, tag == snapshot_true_);
+        return;
+      case snapshot_number_:
+        lua_pushnumber(state_, static_cast<lua_Number>
+                       (DeserializeRaw<double>(buffer, position)));
+        return;
+      case snapshot_string_:
+        length = DeserializeRaw<uint32_t>(buffer, position);
+        if (buffer.size() - position < length)
+          throw Error("Deserialize", "The buffer is truncated.");
+        lua_pushlstring(state_, buffer.data() + position, length);
+        position += length;
+        return;
+      case snapshot_reference_:
+        lua_pushnumber(state_, static_cast<lua_Number>
+                       (DeserializeRaw<uint64_t>(buffer, position)));
+        lua_rawget(state_, table_index);
+        if (!lua_istable(state_, -1) && !lua_isfunction(state_, -1))
+          throw Error("Deserialize", "The buffer refers to an unknown table.");
+        return;
+      case snapshot_table_:
+        if (!lua_checkstack(state_, 4))
+          throw Error("Deserialize", "The tables are too deeply nested.");
+        lua_newtable(state_);
+        lua_pushnumber(state_, static_cast<lua_Number>(start));
+        lua_pushvalue(state_, -2);
+        lua_rawset(state_, table_index);
+        DeserializeTable(buffer, position, table_index, lua_gettop(state_));
+        return;
+      case snapshot_function_:
+        DeserializeFunction(buffer, position, table_index);
+        return;
+      case snapshot_library_:
+        length = DeserializeRaw<uint32_t>(buffer, position);
+        if (buffer.size() - position < length)
+          throw Error("Deserialize", "The buffer is truncated.");
+        name = buffer.substr(position, length);
+        position += length;
+        lua_getfield(state_, LUA_REGISTRYINDEX, "_LOADED");
+        top = lua_gettop(state_);
+        lua_getfield(state_, top, name.substr(0, name.find('.')).c_str());
+        if (name.find('.') != std::string::npos && lua_istable(state_, -1))
+          lua_getfield(state_, -1, name.substr(name.find('.') + 1).c_str());
+        else if (name.find('.') != std::string::npos)
+          lua_pushnil(state_);
+        if (lua_isnil(state_, -1))
+          throw Error("Deserialize", "The buffer refers to \"" + name
+                      + "\", which is not in the standard libraries.");
+        lua_replace(state_, top);
+        lua_settop(state_, top);
+        return;
+      default:
+        throw Error("Deserialize", "The buffer contains an unknown tag.");
+      }
+  }
+
+
+  //! Deserializes the entries of a table.
+  /*! See 'Serialize' for the format.
+    \param[in] buffer the buffer.
+    \param[in,out] position position of the entries in \a buffer, that is,
+    just after the table tag. On exit, it is the position following the
+    entries.
+    \param[in] table_index index in the stack of the table that stores the
+    tables already deserialized, indexed by their position in \a buffer.
+    \param[in] index index in the stack of the table to be filled.
+  */
+  void Ops::DeserializeTable(const std::string& buffer, std::size_t& position,
+                             int table_index, int index)
+  {
+    uint32_t count = DeserializeRaw<uint32_t>(buffer, position);
+    DeserializeRaw<uint64_t>(buffer, position);
+    for (uint32_t i = 0; i < count; i++)
+      {
+        DeserializeValue(buffer, position, table_index);
+        DeserializeValue(buffer, position, table_index);
+        lua_rawset(state_, index);
+      }
+  }
+
+
+  //! Deserializes a function and pushes it onto the stack.
+  /*! See 'Serialize' for the format.
+    \param[in] buffer the buffer.
+    \param[in,out] position position of the function in \a buffer, that is,
+    just after the function tag. On exit, it is the position following the
+    function.
+    \param[in] table_index index in the stack of the table that stores the
+    tables and functions already deserialized, indexed by their position in
+    \a buffer.
+  */
+  void Ops::DeserializeFunction(const std::string& buffer,
+                                std::size_t& position, int table_index)
+  {
+    std::size_t start = position - 1;
+    uint32_t count = DeserializeRaw<uint32_t>(buffer, position);
+    DeserializeRaw<uint64_t>(buffer, position);
+    uint32_t length = DeserializeRaw<uint32_t>(buffer, position);
+    if (buffer.size() - position < length)
+      throw Error("Deserialize", "The buffer is truncated.");
+
+    if (!lua_checkstack(state_, 4))
+      throw Error("Deserialize", "The functions are too deeply nested.");
+    if (luaL_loadbuffer(state_, buffer.data() + position, length,
+                        "=snapshot") != 0)
+      throw Error("Deserialize", lua_tostring(state_, -1));
+    position += length;
+    int function = lua_gettop(state_);
+    lua_pushnumber(state_, static_cast<lua_Number>(start));
+    lua_pushvalue(state_, function);
+    lua_rawset(state_, table_index);
+
+    for (uint32_t i = 1; i <= count; i++)
+      if (DeserializeRaw<unsigned char>(buffer, position) == 0)
+        {
+          DeserializeValue(buffer, position, table_index);
+          if (lua_setupvalue(state_, function, int(i)) == NULL)
+            throw Error("Deserialize", "A function has fewer upvalues than "
+                        "in the buffer.");
+        }
+      else
+        {
+          uint64_t shared = DeserializeRaw<uint64_t>(buffer, position);
+          uint32_t index = DeserializeRaw<uint32_t>(buffer, position);
+#if LUA_VERSION_NUM > 501
+          lua_pushnumber(state_, static_cast<lua_Number>(shared));
+          lua_rawget(state_, table_index);
+          if (!lua_isfunction(state_, -1))
+            throw Error("Deserialize", "The buffer refers to an unknown "
+                        "function.");
+          lua_upvaluejoin(state_, function, int(i), -1, int(index));
+          lua_pop(state_, 1);
+#else
+          throw Error("Deserialize", "Shared upvalues are not supported "
+                      "with Lua 5.1.");
+#endif
+        }
+  }
+
+
+  //! Returns the read entries, to be modified.
+  /*! If the entries were handed out by 'GetReadEntries' (e.g., to an
+    asynchronous writer), they are copied first, so that their holders keep
+    a consistent copy. Whether the holders still use them is not checked:
+    the flag 'read_shared_', unlike the reference count, is never accessed
+    by another thread.
+    \return The read entries of this object.
+  */
+  ReadEntries& Ops::ModifyReadEntries()
+  {
+    if (read_shared_)
+      {
+        read_ = std::make_shared<ReadEntries>(*read_);
+        read_shared_ = false;
+      }
+    return *read_;
+  }
+
+
+  //! Returns all read entries.
+  /*!
+    \return The read entries. They are not modified afterwards: the
+    subsequent reads are recorded in a copy.
+  */
+  std::shared_ptr<const ReadEntries> Ops::GetReadEntries()
+  {
+    read_shared_ = true;
+    return read_;
+  }
+
+
   //! Stores the value of an entry.
   /*!
     \param[in] name the name of the entry.
@@ -1104,7 +2909,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const bool& value)
   {
-    read_bool[name] = value;
+    ModifyReadEntries().read_bool[name] = value;
   }
 
 
@@ -1115,7 +2920,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const int& value)
   {
-    read_int[name] = value;
+    ModifyReadEntries().read_int[name] = value;
   }
 
 
@@ -1126,7 +2931,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const float& value)
   {
-    read_float[name] = value;
+    ModifyReadEntries().read_float[name] = value;
   }
 
 
@@ -1137,7 +2942,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const double& value)
   {
-    read_double[name] = value;
+    ModifyReadEntries().read_double[name] = value;
   }
 
 
@@ -1148,7 +2953,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const std::string& value)
   {
-    read_string[name] = value;
+    ModifyReadEntries().read_string[name] = value;
   }
 
 
@@ -1159,7 +2964,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const std::vector<bool>& value)
   {
-    read_vect_bool[name] = value;
+    ModifyReadEntries().read_vect_bool[name] = value;
   }
 
 
@@ -1170,7 +2975,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const std::vector<int>& value)
   {
-    read_vect_int[name] = value;
+    ModifyReadEntries().read_vect_int[name] = value;
   }
 
 
@@ -1181,7 +2986,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const std::vector<float>& value)
   {
-    read_vect_float[name] = value;
+    ModifyReadEntries().read_vect_float[name] = value;
   }
 
 
@@ -1192,7 +2997,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const std::vector<double>& value)
   {
-    read_vect_double[name] = value;
+    ModifyReadEntries().read_vect_double[name] = value;
   }
 
 
@@ -1203,7 +3008,7 @@ namespace Ops
   */
   void Ops::Push(std::string name, const std::vector<std::string>& value)
   {
-    read_vect_string[name] = value;
+    ModifyReadEntries().read_vect_string[name] = value;
   }
 }
 
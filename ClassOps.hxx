@@ -18,13 +18,53 @@
 
 #ifndef OPS_FILE_CLASSOPS_HXX
 
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
+#include "Predicate.hxx"
+
+// 'Ops::ApplyAsync' requires C++20 coroutines, and the definition of the
+// pool. Otherwise, the pool is only declared.
+#if !defined(SWIG) && defined(__cpp_impl_coroutine)
+#include "ApplyPool.hxx"
+#endif
+
+// 'Ops::Value' requires C++17.
+#if !defined(SWIG) && (__cplusplus >= 201703L                   \
+                       || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#define OPS_WITH_VALUE
+#include <variant>
+#endif
+
 namespace Ops
 {
 
+  class ApplyPool;
+  class Journal;
+
+#ifdef OPS_WITH_VALUE
+  //! Value of an entry whose type is not known in advance.
+  /*! See 'Ops::Get<Value>'.
+   */
+  typedef std::variant<bool, int, double, std::string, std::vector<bool>,
+                       std::vector<int>, std::vector<double>,
+                       std::vector<std::string> > Value;
+#endif
+
+#ifndef SWIG
+  //! Function that sends a buffer from the root process to the others.
+  /*! On the root process, the buffer is sent. On the other processes, it is
+    replaced with the buffer received. See 'Ops::OpenBroadcast'.
+  */
+  typedef std::function<void(std::string& buffer)> Broadcast;
+#endif
+
   class Ops
   {
   protected:
@@ -35,26 +75,44 @@ namespace Ops
     //! Prefix to be prepended to the entries names.
     std::string prefix_;
 
-    //! Names and values of all Booleans read in the file.
-    std::map<std::string, bool> read_bool;
-    //! Names and values of all integer read in the file.
-    std::map<std::string, int> read_int;
-    //! Names and values of all floats read in the file.
-    std::map<std::string, float> read_float;
-    //! Names and values of all doubles read in the file.
-    std::map<std::string, double> read_double;
-    //! Names and values of all strings read in the file.
-    std::map<std::string, std::string> read_string;
-    //! Names and values of all vectors of Booleans read in the file.
-    std::map<std::string, std::vector<bool> > read_vect_bool;
-    //! Names and values of all vectors of integers read in the file.
-    std::map<std::string, std::vector<int> > read_vect_int;
-    //! Names and values of all vectors of floats read in the file.
-    std::map<std::string, std::vector<float> > read_vect_float;
-    //! Names and values of all vectors of doubles read in the file.
-    std::map<std::string, std::vector<double> > read_vect_double;
-    //! Names and values of all vectors of strings read in the file.
-    std::map<std::string, std::vector<std::string> > read_vect_string;
+    //! Names and values of all entries read in the file, shared with the
+    //! asynchronous writers.
+    std::shared_ptr<ReadEntries> read_;
+    //! Has 'read_' been handed out by 'GetReadEntries'? If so, it is copied
+    //! before being modified.
+    bool read_shared_;
+
+    //! Should 'Open' record the report of its phases?
+    bool record_open_report_;
+    //! Report of the phases of the last call to 'Open'.
+    PhaseReport open_report_;
+    //! Phases in progress, from the outermost one.
+    std::vector<PhaseReport*> open_phase_;
+
+    //! Sampling profiler of the Lua code.
+    Profiler profiler_;
+
+    //! Journal of the overridden entries.
+    std::unique_ptr<Journal> journal_;
+
+    //! Pool of Lua states used by 'ApplyAsync', if started.
+    std::unique_ptr<ApplyPool> apply_pool_;
+
+    //! Are the entries accessed without metamethods?
+    bool raw_access_;
+    //! Address used as a key of the inheritance cache in the Lua registry.
+    static char inheritance_cache_key_;
+    //! Address used as the key of the function 'ops.load_all' in the Lua
+    //! registry, once the module 'ops' is loaded.
+    static char ops_module_key_;
+
+    //! Are the constraints checked by 'Validate' instead of on read?
+    bool deferred_validation_;
+    //! Names (with the prefix) of the entries read in deferred mode, with
+    //! their constraints.
+    std::vector<std::pair<std::string, std::string> > deferred_constraint_;
+    //! Protects 'deferred_constraint_'.
+    std::mutex deferred_mutex_;
 
   public:
     // Constructor and destructor.
@@ -79,6 +137,21 @@ namespace Ops
     T Get(std::string name, std::string constraint);
     template<class T>
     T Get(std::string name, std::string constraint, const T& default_value);
+#ifndef SWIG
+    template<class F, class TD, class T>
+    typename std::enable_if<IsPredicate<F, T>::value>::type
+    Set(std::string name, const F& predicate, const TD& default_value,
+        T& value);
+    template<class F, class T>
+    typename std::enable_if<IsPredicate<F, T>::value>::type
+    Set(std::string name, const F& predicate, T& value);
+    template<class T, class F>
+    typename std::enable_if<IsPredicate<F, T>::value, T>::type
+    Get(std::string name, const F& predicate);
+    template<class T, class F>
+    typename std::enable_if<IsPredicate<F, T>::value, T>::type
+    Get(std::string name, const F& predicate, const T& default_value);
+#endif
     template<class Tin, class Tout>
     void Apply(std::string name, const std::vector<Tin>& in,
                std::vector<Tout>& OUTPUT);
@@ -94,10 +167,31 @@ namespace Ops
     template<class T>
     T Apply(std::string name, const T& arg0, const T& arg1, const T& arg2,
             const T& arg3, const T& arg4);
+    void ApplyArray(std::string name, int Narg, const double* const* in,
+                    std::size_t size, double* out);
+#ifdef OPS_WITH_COROUTINE
+    template<class T, class... Targ>
+    ApplyAwaiter<T> ApplyAsync(std::string name, const T& arg0,
+                               const Targ&... arg);
+#endif
+#ifndef SWIG
+    // 'executor' is an 'ApplyPool::Executor'.
+    void StartApplyPool(int worker_count = 0, std::size_t queue_capacity = 64,
+                        std::function<void(std::function<void()>)> executor
+                        = nullptr);
+#endif
+    void StopApplyPool();
     std::vector<std::string> GetEntryList(std::string name = "");
     bool CheckConstraint(std::string name, std::string constraint);
     bool CheckConstraintOnValue(std::string value, std::string constraint);
+    void Validate();
+#ifndef SWIG
+    std::future<std::vector<std::string> > ValidateAsync();
+#endif
     void PutOnStack(std::string name);
+#ifdef OPS_WITH_VALUE
+    Value GetOnStack(std::string name);
+#endif
     bool Exists(std::string name);
     void PushOnStack(bool value);
     void PushOnStack(int value);
@@ -114,6 +208,21 @@ namespace Ops
 
     void DoFile(std::string file_path);
     void DoString(std::string expression);
+    template<class T>
+    void Override(std::string name, const T& value);
+    void OpenJournal(std::string file_path, int sync_period = 64,
+                     int compaction_period = 0);
+    void CloseJournal();
+    void ReplayJournal(std::string file_path);
+
+    std::string Serialize();
+    void Deserialize(const std::string& buffer);
+    void WriteSnapshot(std::string file_path);
+    void ReadSnapshot(std::string file_path);
+#ifndef SWIG
+    void OpenBroadcast(std::string file_path, bool root,
+                       const Broadcast& broadcast);
+#endif
 
     // Access methods.
     std::string GetFilePath() const;
@@ -129,8 +238,60 @@ namespace Ops
     std::string LuaDefinition(std::string name);
     std::string LuaDefinition();
     void WriteLuaDefinition(std::string file_name);
+#ifndef SWIG
+    std::future<std::string> WriteLuaDefinitionAsync(std::string file_name);
+#endif
+    void EnableOpenReport(bool enable = true);
+    const PhaseReport& OpenReport() const;
+    void StartProfiler(int period = 1000);
+    void StopProfiler();
+    Profiler& GetProfiler();
+    Journal& GetJournal();
+#ifndef SWIG
+    ApplyPool& GetApplyPool();
+#endif
+    void SetRawAccess(bool raw_access = true);
+    bool GetRawAccess() const;
+    void SetDeferredValidation(bool deferred = true);
+    bool GetDeferredValidation() const;
+    void ClearInheritanceCache();
 
   protected:
+    //! Version of the format of 'Serialize'.
+    static const uint32_t snapshot_version_ = 2;
+    //! Tags of the values serialized by 'Serialize'.
+    enum
+      {
+        snapshot_false_ = 1,
+        snapshot_true_ = 2,
+        snapshot_number_ = 3,
+        snapshot_string_ = 4,
+        snapshot_table_ = 5,
+        snapshot_reference_ = 6,
+        snapshot_function_ = 7,
+        snapshot_library_ = 8,
+        snapshot_nil_ = 9
+      };
+    //! Objects already met during a serialization.
+    struct SnapshotWriter
+    {
+      //! Positions of the tables and functions already serialized.
+      std::map<const void*, uint64_t> position;
+      //! Names of the objects of the standard libraries.
+      std::map<const void*, std::string> library;
+      //! Functions and indexes of the upvalues already serialized.
+      std::map<const void*, std::pair<uint64_t, uint32_t> > upvalue;
+    };
+
+    int TryOpen(std::string file_path, bool close_state);
+    void NewState();
+    void BeginPhase(std::string phase, const std::string& name = "");
+    void EndPhase();
+    long LuaMemory() const;
+    static int DoFileReport(lua_State* state);
+    static int LoadOpsModule(lua_State* state);
+    static int DumpFunction(lua_State* state, const void* data, size_t size,
+                            void* buffer);
     bool Convert(int index, std::vector<bool>::reference output,
                  std::string name = "");
     bool Convert(int index, bool& output, std::string name = "");
@@ -139,21 +300,48 @@ namespace Ops
     bool Convert(int index, double& output, std::string name = "");
     bool Convert(int index, std::string& output, std::string name = "");
     template<class TD, class T>
-    void SetValue(std::string name, std::string constraint,
-                  const TD& default_value, bool with_default, T& value);
+    bool SetValue(std::string name, std::string constraint,
+                  const TD& default_value, bool with_default, T& value,
+                  std::vector<std::string>* key_output = NULL);
     template<class T>
-    void SetValue(std::string name, std::string constraint,
+    bool SetValue(std::string name, std::string constraint,
                   const std::vector<T>& default_value, bool with_default,
-                  std::vector<T>& value);
+                  std::vector<T>& value,
+                  std::vector<std::string>* key_output = NULL);
+    template<class F, class T>
+    void CheckPredicate(std::string name, const F& predicate,
+                        const T& value,
+                        const std::vector<std::string>& key_list) const;
+    template<class F, class T>
+    void CheckPredicate(std::string name, const F& predicate,
+                        const std::vector<T>& value,
+                        const std::vector<std::string>& key_list) const;
     std::string Constraint(std::string constraint) const;
+    bool DeferConstraint(const std::string& name,
+                         const std::string& constraint);
+    std::vector<std::string>
+    CheckConstraints(const std::vector<std::pair<std::string, std::string> >&
+                     constraint);
     std::string Name(const std::string& name) const;
     std::string Entry(const std::string& name) const;
     std::string Function(const std::string& name) const;
     void WalkDown(std::string name);
     template<class T>
+    void PushValue(const T& value);
+    template<class T>
+    void PushValue(const std::vector<T>& value);
+    void Assign(std::string name, bool journal);
+    void GetField(const std::string& key);
+    bool Flatten(int depth = 0);
+    void LoadLazy();
+    bool IsThunk(int index);
+    bool ForceThunk();
+    template<class T>
     bool IsParam(std::string name, T& value);
     template<class T>
     bool IsParam(std::string name, std::vector<T>& value);
+    ReadEntries& ModifyReadEntries();
+    std::shared_ptr<const ReadEntries> GetReadEntries();
     void Push(std::string name, const bool& value);
     void Push(std::string name, const int& value);
     void Push(std::string name, const float& value);
@@ -164,13 +352,33 @@ namespace Ops
     void Push(std::string name, const std::vector<float>& value);
     void Push(std::string name, const std::vector<double>& value);
     void Push(std::string name, const std::vector<std::string>& value);
-    template<class TK, class T>
-    void AppendKey(const std::map<TK, T>& input, std::vector<TK>& vect);
+    bool IsSerializable(int index, const SnapshotWriter& writer) const;
+    void IndexLibrary(SnapshotWriter& writer);
+    void SerializeValue(int index, std::string& buffer,
+                        SnapshotWriter& writer, bool skip_library = false);
+    void SerializeFunction(int index, std::string& buffer,
+                           SnapshotWriter& writer);
+    void DeserializeValue(const std::string& buffer, std::size_t& position,
+                          int table_index);
+    void DeserializeTable(const std::string& buffer, std::size_t& position,
+                          int table_index, int index);
+    void DeserializeFunction(const std::string& buffer, std::size_t& position,
+                             int table_index);
+    template<class T>
+    void SerializeRaw(const T& value, std::string& buffer) const;
+    template<class T>
+    T DeserializeRaw(const std::string& buffer, std::size_t& position) const;
   };
 
+#ifdef OPS_WITH_VALUE
+  template<>
+  Value Ops::Get<Value>(std::string name);
+#endif
+
 }
 
 #include <ClassOps_impl.hxx>
+#include <OpsInstantiation.hxx>
 
 #define OPS_FILE_CLASSOPS_HXX
 #endif
@@ -109,6 +109,82 @@ namespace Ops
   }
 
 
+#ifndef SWIG
+  //! Retrieves a value and checks it with a C++ predicate.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] predicate the predicate that the entry value must satisfy
+    (see 'Predicate'). For a vector, it is applied to every element.
+    \param[in] default_value default value for the entry in case it is not
+    found in the configuration file.
+    \param[out] value value of the entry.
+    \note The default value may not satisfy the predicate.
+  */
+  template<class F, class TD, class T>
+  typename std::enable_if<IsPredicate<F, T>::value>::type
+  Ops::Set(std::string name, const F& predicate, const TD& default_value,
+           T& value)
+  {
+    std::vector<std::string> key_list;
+    if (SetValue(name, "", default_value, true, value, &key_list))
+      CheckPredicate(name, predicate, value, key_list);
+  }
+
+
+  //! Retrieves a value and checks it with a C++ predicate.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] predicate the predicate that the entry value must satisfy
+    (see 'Predicate'). For a vector, it is applied to every element.
+    \param[out] value value of the entry.
+  */
+  template<class F, class T>
+  typename std::enable_if<IsPredicate<F, T>::value>::type
+  Ops::Set(std::string name, const F& predicate, T& value)
+  {
+    std::vector<std::string> key_list;
+    SetValue(name, "", value, false, value, &key_list);
+    CheckPredicate(name, predicate, value, key_list);
+  }
+
+
+  //! Retrieves a value and checks it with a C++ predicate.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] predicate the predicate that the entry value must satisfy
+    (see 'Predicate'). For a vector, it is applied to every element.
+    \return The value of the entry.
+  */
+  template<class T, class F>
+  typename std::enable_if<IsPredicate<F, T>::value, T>::type
+  Ops::Get(std::string name, const F& predicate)
+  {
+    T value;
+    Set(name, predicate, value);
+    return value;
+  }
+
+
+  //! Retrieves a value and checks it with a C++ predicate.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] predicate the predicate that the entry value must satisfy
+    (see 'Predicate'). For a vector, it is applied to every element.
+    \param[in] default_value default value for the entry in case it is not
+    found in the configuration file.
+    \return The value of the entry.
+  */
+  template<class T, class F>
+  typename std::enable_if<IsPredicate<F, T>::value, T>::type
+  Ops::Get(std::string name, const F& predicate, const T& default_value)
+  {
+    T value;
+    Set(name, predicate, default_value, value);
+    return value;
+  }
+#endif
+
+
   //! Applies a Lua function.
   /*!
     \param[in] name name of the function.
@@ -120,6 +196,9 @@ namespace Ops
   void Ops::Apply(std::string name, const std::vector<Tin>& in,
                   std::vector<Tout>& out)
   {
+    OPS_INSTRUMENT(instrument_apply, name);
+    ProfilerContext profiler_context(profiler_, "Apply", name);
+
     PutOnStack(Name(name));
     PushOnStack(in);
 
@@ -254,6 +333,39 @@ namespace Ops
   }
 
 
+#ifdef OPS_WITH_COROUTINE
+  //! Applies a Lua function in the pool of Lua states, asynchronously.
+  /*! The result is obtained with 'co_await' in a C++20 coroutine, which is
+    suspended until the call completes in a worker of the pool (see
+    'StartApplyPool'). An exception raised by the call is raised by
+    'co_await'.
+    \param[in] name name of the function.
+    \param[in] arg0 first parameter of the function.
+    \param[in] arg the other parameters of the function, converted to \a T.
+    \return The awaitable call, whose result is the first output of the
+    function.
+    \note The prefix is prepended to \a name.
+  */
+  template<class T, class... Targ>
+  ApplyAwaiter<T> Ops::ApplyAsync(std::string name, const T& arg0,
+                                  const Targ&... arg)
+  {
+    std::string function = Name(name);
+    std::vector<T> in = {arg0, static_cast<T>(arg)...};
+    return ApplyAwaiter<T>(GetApplyPool(), [function, in](Ops& ops)
+                           {
+                             std::vector<T> out;
+                             ops.Apply(function, in, out);
+                             if (out.empty())
+                               throw Error("ApplyAsync", "The function \""
+                                           + function + "\" returned no "
+                                           "value.");
+                             return out[0];
+                           });
+  }
+#endif
+
+
   //! Checks whether \a name is of type 'T'.
   /*! On exit, the value of the entry (if it exists) is on the stack.
     \param[in] name the name of the entry whose type is checked.
@@ -269,6 +381,24 @@ namespace Ops
   }
 
 
+  //! Overrides the value of an entry.
+  /*! The value is assigned in Lua, as with 'DoString', but without running
+    the Lua compiler. If a journal is open (see 'OpenJournal'), the entry and
+    its value are appended to the journal.
+    \param[in] name the name of the entry. The table that contains the entry
+    must exist.
+    \param[in] value the new value: a bool, an int, a float, a double, a
+    std::string or a vector of these types, converted into a Lua table.
+    \note The prefix is prepended to \a name.
+  */
+  template<class T>
+  void Ops::Override(std::string name, const T& value)
+  {
+    PushValue(value);
+    Assign(Name(name), true);
+  }
+
+
   //! Pushes a vector onto the stack.
   /*! Every element of the vector \a v is pushed onto the stack, in the same
     order as in the vector.
@@ -295,12 +425,15 @@ namespace Ops
     \param[in] with_default is there a default value? If not, \a default_value
     is ignored.
     \param[out] value the value of the entry named \a name.
+    \param[out] key_output ignored: it is only used for vectors.
+    \return True if the entry was found, false if the default value was
+    used.
     \note The default value may not satisfy the constraint.
   */
   template<class TD, class T>
-  void Ops::SetValue(std::string name, std::string constraint,
+  bool Ops::SetValue(std::string name, std::string constraint,
                      const TD& default_value, bool with_default,
-                     T& value)
+                     T& value, std::vector<std::string>* /* key_output */)
   {
     PutOnStack(Name(name));
 
@@ -310,7 +443,7 @@ namespace Ops
         {
           value = default_value;
           ClearStack();
-          return;
+          return false;
         }
       else
         throw Error("SetValue",
@@ -318,7 +451,8 @@ namespace Ops
     }
     Convert(-1, value, name);
 
-    if (!CheckConstraint(name, constraint))
+    if (!DeferConstraint(name, constraint)
+        && !CheckConstraint(name, constraint))
       throw Error("SetValue",
                   "The " + Entry(name) + " does not satisfy "
                   + "the constraint:\n" + Constraint(constraint));
@@ -326,6 +460,7 @@ namespace Ops
     ClearStack();
 
     Push(Name(name), value);
+    return true;
   }
 
 
@@ -337,12 +472,17 @@ namespace Ops
     \param[in] with_default is there a default value? If not, \a default_value
     is ignored.
     \param[out] value the value of the entry named \a name.
+    \param[out] key_output if not NULL, the keys of the elements of \a value
+    (in the same order), if the entry was found.
+    \return True if the entry was found, false if the default value was
+    used.
     \note The default value may not satisfy the constraint.
   */
   template<class T>
-  void Ops::SetValue(std::string name, std::string constraint,
+  bool Ops::SetValue(std::string name, std::string constraint,
                      const std::vector<T>& default_value, bool with_default,
-                     std::vector<T>& value)
+                     std::vector<T>& value,
+                     std::vector<std::string>* key_output)
   {
     PutOnStack(Name(name));
 
@@ -352,7 +492,7 @@ namespace Ops
         {
           value = default_value;
           ClearStack();
-          return;
+          return false;
         }
       else
         throw Error("SetValue",
@@ -362,6 +502,9 @@ namespace Ops
       throw Error("SetValue",
                   "The " + Entry(name) + " is not a table.");
 
+    // The inherited elements are read as well.
+    Flatten();
+
     std::vector<T> element_list;
     T element;
     std::vector<std::string> key_list;
@@ -387,17 +530,48 @@ namespace Ops
       }
 
     for (std::size_t i = 0; i < key_list.size(); i++)
-      if (!CheckConstraint(name + "[" + key_list[i] + "]", constraint))
+      if (!DeferConstraint(name + "[" + key_list[i] + "]", constraint)
+          && !CheckConstraint(name + "[" + key_list[i] + "]", constraint))
         throw Error("SetValue",
                     "The " + Entry(name + "[" + key_list[i] + "]")
                     + " does not satisfy the constraint:\n"
                     + Constraint(constraint));
 
     value = element_list;
+    if (key_output != NULL)
+      key_output->swap(key_list);
 
     ClearStack();
 
     Push(Name(name), value);
+    return true;
+  }
+
+
+  //! Pushes a value onto the stack.
+  /*!
+    \param[in] value the value to be pushed.
+  */
+  template<class T>
+  void Ops::PushValue(const T& value)
+  {
+    PushOnStack(value);
+  }
+
+
+  //! Pushes a vector onto the stack, as a Lua table.
+  /*!
+    \param[in] value the vector to be pushed.
+  */
+  template<class T>
+  void Ops::PushValue(const std::vector<T>& value)
+  {
+    lua_createtable(state_, static_cast<int>(value.size()), 0);
+    for (std::size_t i = 0; i < value.size(); i++)
+      {
+        PushOnStack(static_cast<T>(value[i]));
+        lua_rawseti(state_, -2, static_cast<int>(i + 1));
+      }
   }
 
 
@@ -431,7 +605,7 @@ namespace Ops
     exception is raised.
   */
   template<class T>
-  bool Ops::IsParam(std::string name, std::vector<T>& value)
+  bool Ops::IsParam(std::string name, std::vector<T>& /* value */)
   {
     PutOnStack(Name(name));
 
@@ -442,6 +616,8 @@ namespace Ops
     if (!lua_istable(state_, -1))
       return false;
 
+    Flatten();
+
     T element;
     // Now loops over all elements of the table.
     lua_pushnil(state_);
@@ -460,17 +636,77 @@ namespace Ops
   }
 
 
-  //! Pushes all keys of a map into a vector.
+  //! Checks a value with a C++ predicate.
   /*!
-    \param[in] input the map whose keys should be pushed.
-    \param[in,out] vect the vector to which the map keys are pushed back.
+    \param[in] name name of the entry.
+    \param[in] predicate the predicate.
+    \param[in] value the value of the entry.
+    \param[in] key_list ignored: it is only used for vectors.
   */
-  template<class TK, class T>
-  void Ops::AppendKey(const std::map<TK, T>& input, std::vector<TK>& vect)
+  template<class F, class T>
+  void Ops::CheckPredicate(std::string name, const F& predicate,
+                           const T& value,
+                           const std::vector<std::string>& /* key_list */)
+    const
   {
-    typename std::map<TK, T>::const_iterator i;
-    for (i = input.begin(); i != input.end(); i++)
-      vect.push_back(i->first);
+    if (!predicate(value))
+      throw Error("SetValue",
+                  "The " + Entry(name) + " does not satisfy "
+                  + "the constraint:\n"
+                  + Constraint(DescribePredicate(predicate)));
+  }
+
+
+  //! Checks the elements of a vector with a C++ predicate.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] predicate the predicate.
+    \param[in] value the value of the entry.
+    \param[in] key_list the keys of the elements of \a value in the Lua
+    table, in the same order, as returned by 'SetValue'.
+  */
+  template<class F, class T>
+  void Ops::CheckPredicate(std::string name, const F& predicate,
+                           const std::vector<T>& value,
+                           const std::vector<std::string>& key_list) const
+  {
+    for (std::size_t i = 0; i < value.size(); i++)
+      if (!predicate(value[i]))
+        throw Error("SetValue",
+                    "The " + Entry(name + "[" + key_list[i] + "]")
+                    + " does not satisfy the constraint:\n"
+                    + Constraint(DescribePredicate(predicate)));
+  }
+
+
+  //! Appends the binary representation of a value to a buffer.
+  /*!
+    \param[in] value the value, of a fundamental type.
+    \param[in,out] buffer the buffer.
+  */
+  template<class T>
+  void Ops::SerializeRaw(const T& value, std::string& buffer) const
+  {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+
+  //! Reads a value in binary representation from a buffer.
+  /*!
+    \param[in] buffer the buffer.
+    \param[in,out] position position of the value in \a buffer. On exit, it
+    is the position following the value.
+    \return The value, of a fundamental type.
+  */
+  template<class T>
+  T Ops::DeserializeRaw(const std::string& buffer, std::size_t& position) const
+  {
+    if (position > buffer.size() || buffer.size() - position < sizeof(T))
+      throw Error("Deserialize", "The buffer is truncated.");
+    T value;
+    std::memcpy(&value, buffer.data() + position, sizeof(T));
+    position += sizeof(T);
+    return value;
   }
 
 
@@ -18,7 +18,9 @@
 
 #ifndef OPS_FILE_ERROR_CXX
 
-#include "OpsHeader.hxx"
+// This file does not depend on Lua: it is also part of the snapshot reader.
+#include <iostream>
+
 #include "Error.hxx"
 
 
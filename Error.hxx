@@ -20,6 +20,10 @@
 
 #include <string>
 
+#ifndef OPS_WITH_EXCEPTION
+#define OPS_WITH_ABORT
+#endif
+
 #ifdef OPS_WITH_ABORT
 #include <cstdlib>
 #endif
@@ -0,0 +1,364 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+
+#ifndef OPS_FILE_JOURNAL_CXX
+
+
+#include "OpsHeader.hxx"
+#include "Journal.hxx"
+
+#include <iterator>
+#include <set>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace Ops
+{
+
+
+  //! Default constructor.
+  /*! No journal is open.
+   */
+  Journal::Journal():
+    file_(NULL), sync_period_(64), compaction_period_(0), unsynced_(0),
+    uncompacted_(0)
+  {
+  }
+
+
+  //! Destructor.
+  /*! The journal is flushed to the disk and closed.
+   */
+  Journal::~Journal()
+  {
+    if (file_ != NULL)
+      {
+        Sync();
+        std::fclose(file_);
+      }
+  }
+
+
+  //! Opens a journal for appending.
+  /*! The journal is created if it does not exist. An incomplete record at
+    the end of the journal, e.g., after a crash, is removed. The journal
+    previously open, if any, is closed.
+    \param[in] file_path path to the journal.
+    \param[in] sync_period number of records between two flushes to the
+    disk.
+    \param[in] compaction_period number of records between two compactions
+    (see 'Compact'), or 0 for no automatic compaction.
+  */
+  void Journal::Open(std::string file_path, int sync_period,
+                     int compaction_period)
+  {
+    if (sync_period <= 0 || compaction_period < 0)
+      throw Error("Journal::Open", "The periods must be positive.");
+    Close();
+
+    // Checks the header, or writes it.
+    std::ifstream f(file_path.c_str(), std::ios::binary | std::ios::ate);
+    if (!f.is_open())
+      Write(file_path,
+            std::vector<std::pair<std::string, std::string> >());
+    else
+      {
+        std::size_t size = static_cast<std::size_t>(f.tellg());
+        f.close();
+        std::size_t end;
+        std::vector<std::pair<std::string, std::string> > record
+          = Read(file_path, end);
+        // An incomplete record at the end is cut, otherwise the new records
+        // would be appended after it and never read.
+        if (end != size)
+          {
+            std::string temporary_path = file_path + ".tmp";
+            Write(temporary_path, record);
+            if (std::rename(temporary_path.c_str(), file_path.c_str()) != 0)
+              {
+                std::remove(temporary_path.c_str());
+                throw Error("Journal::Open", "Failed to rename \""
+                            + temporary_path + "\" to \"" + file_path
+                            + "\".");
+              }
+          }
+      }
+
+    file_ = std::fopen(file_path.c_str(), "ab");
+    if (file_ == NULL)
+      throw Error("Journal::Open", "Unable to open \"" + file_path + "\".");
+    file_path_ = file_path;
+    sync_period_ = sync_period;
+    compaction_period_ = compaction_period;
+    unsynced_ = 0;
+    uncompacted_ = 0;
+  }
+
+
+  //! Flushes the journal to the disk and closes it.
+  void Journal::Close()
+  {
+    if (file_ == NULL)
+      return;
+    Sync();
+    std::fclose(file_);
+    file_ = NULL;
+    file_path_ = "";
+  }
+
+
+  //! Is a journal open?
+  /*!
+    \return True if a journal is open, false otherwise.
+  */
+  bool Journal::IsOpen() const
+  {
+    return file_ != NULL;
+  }
+
+
+  //! Returns the path to the journal.
+  /*!
+    \return The path to the journal, or an empty string if no journal is
+    open.
+  */
+  std::string Journal::GetFilePath() const
+  {
+    return file_path_;
+  }
+
+
+  //! Appends a record to the journal.
+  /*! The journal is flushed to the disk every 'sync_period' records, and
+    compacted every 'compaction_period' records.
+    \param[in] name the name of the entry.
+    \param[in] value the value of the entry, in the format of
+    'Ops::Serialize'.
+  */
+  void Journal::Append(const std::string& name, const std::string& value)
+  {
+    if (file_ == NULL)
+      throw Error("Journal::Append", "No journal is open.");
+
+    uint32_t name_length = static_cast<uint32_t>(name.size());
+    uint64_t value_length = static_cast<uint64_t>(value.size());
+    std::string record(reinterpret_cast<const char*>(&name_length),
+                       sizeof(name_length));
+    record += name;
+    record.append(reinterpret_cast<const char*>(&value_length),
+                  sizeof(value_length));
+    record += value;
+    // A single write, so that a record is not interleaved with another one.
+    if (std::fwrite(record.data(), 1, record.size(), file_) != record.size())
+      throw Error("Journal::Append", "Failed to write in \"" + file_path_
+                  + "\".");
+
+    if (++unsynced_ >= sync_period_)
+      Sync();
+    if (compaction_period_ > 0 && ++uncompacted_ >= compaction_period_)
+      Compact();
+  }
+
+
+  //! Flushes the journal to the disk.
+  void Journal::Sync()
+  {
+    if (file_ == NULL)
+      return;
+    bool failed = std::fflush(file_) != 0;
+#ifdef _WIN32
+    failed = failed || _commit(_fileno(file_)) != 0;
+#else
+    failed = failed || fsync(fileno(file_)) != 0;
+#endif
+    if (failed)
+      throw Error("Journal::Sync", "Failed to write in \"" + file_path_
+                  + "\".");
+    unsynced_ = 0;
+  }
+
+
+  //! Compacts the journal.
+  /*! The records that are overridden by a later record, on the same entry
+    or on an entry that contains it, are removed. The journal is rewritten
+    in a temporary file, which then replaces the journal atomically. Replaying
+    the compacted journal gives the same entries as replaying the full
+    journal. If the journal cannot be replaced, it is left uncompacted and
+    open, and an exception is raised.
+  */
+  void Journal::Compact()
+  {
+    if (file_ == NULL)
+      throw Error("Journal::Compact", "No journal is open.");
+    Sync();
+
+    // Going backward, a record is kept if no later record overrides it.
+    std::vector<std::pair<std::string, std::string> > record
+      = Read(file_path_), compacted;
+    std::set<std::string> overriding;
+    for (std::size_t i = record.size(); i > 0; i--)
+      {
+        const std::string& name = record[i - 1].first;
+        bool overridden = overriding.count(name) != 0;
+        for (std::size_t end = name.find_first_of(".[");
+             end != std::string::npos && !overridden;
+             end = name.find_first_of(".[", end + 1))
+          overridden = overriding.count(name.substr(0, end)) != 0;
+        if (!overridden)
+          {
+            compacted.push_back(record[i - 1]);
+            overriding.insert(name);
+          }
+      }
+    std::reverse(compacted.begin(), compacted.end());
+
+    std::string temporary_path = file_path_ + ".tmp";
+    Write(temporary_path, compacted);
+    std::fclose(file_);
+    file_ = NULL;
+    bool renamed
+      = std::rename(temporary_path.c_str(), file_path_.c_str()) == 0;
+    if (!renamed)
+      std::remove(temporary_path.c_str());
+    // The journal, compacted or not, is open again before any error is
+    // raised.
+    file_ = std::fopen(file_path_.c_str(), "ab");
+    if (file_ == NULL)
+      {
+        std::string file_path = file_path_;
+        file_path_ = "";
+        throw Error("Journal::Compact", "Unable to open \"" + file_path
+                    + "\".");
+      }
+    if (!renamed)
+      throw Error("Journal::Compact", "Failed to rename \""
+                  + temporary_path + "\" to \"" + file_path_ + "\".");
+    uncompacted_ = 0;
+  }
+
+
+  //! Reads all records of a journal.
+  /*! An incomplete record at the end of the journal, e.g., after a crash, is
+    ignored.
+    \param[in] file_path path to the journal.
+    \return The names and the values of the records, in chronological order.
+  */
+  std::vector<std::pair<std::string, std::string> >
+  Journal::Read(std::string file_path)
+  {
+    std::size_t end;
+    return Read(file_path, end);
+  }
+
+
+  //! Reads all records of a journal.
+  /*! An incomplete record at the end of the journal, e.g., after a crash, is
+    ignored.
+    \param[in] file_path path to the journal.
+    \param[out] end the offset, in bytes, of the end of the last complete
+    record (or of the header, if there is no complete record). It is less
+    than the size of the journal if the last record is incomplete.
+    \return The names and the values of the records, in chronological order.
+  */
+  std::vector<std::pair<std::string, std::string> >
+  Journal::Read(std::string file_path, std::size_t& end)
+  {
+    std::ifstream f(file_path.c_str(), std::ios::binary);
+    if (!f.is_open())
+      throw Error("Journal::Read", "Unable to open \"" + file_path + "\".");
+    std::string buffer((std::istreambuf_iterator<char>(f)),
+                       std::istreambuf_iterator<char>());
+
+    uint32_t version = 0;
+    if (buffer.size() >= 12)
+      std::memcpy(&version, buffer.data() + 8, sizeof(version));
+    if (buffer.size() < 12 || buffer.compare(0, 8, std::string("OPSJRNL", 8))
+        || version != version_)
+      throw Error("Journal::Read", "\"" + file_path + "\" is not a journal, "
+                  "or it was written with an unsupported format or byte "
+                  "order.");
+
+    std::vector<std::pair<std::string, std::string> > record;
+    std::size_t position = 12;
+    end = position;
+    uint32_t name_length;
+    uint64_t value_length;
+    while (buffer.size() - position >= sizeof(name_length))
+      {
+        std::memcpy(&name_length, buffer.data() + position,
+                    sizeof(name_length));
+        position += sizeof(name_length);
+        if (buffer.size() - position < name_length + sizeof(value_length))
+          break;
+        std::string name = buffer.substr(position, name_length);
+        position += name_length;
+        std::memcpy(&value_length, buffer.data() + position,
+                    sizeof(value_length));
+        position += sizeof(value_length);
+        if (buffer.size() - position < value_length)
+          break;
+        record.push_back(std::make_pair(name, buffer.substr(position,
+                                                       value_length)));
+        position += value_length;
+        end = position;
+      }
+
+    return record;
+  }
+
+
+  //! Writes a journal.
+  /*! The journal is replaced if it exists. It is flushed to the disk.
+    \param[in] file_path path to the journal.
+    \param[in] record the names and the values of the records.
+  */
+  void Journal::Write(std::string file_path,
+                      const std::vector<std::pair<std::string, std::string> >&
+                      record)
+  {
+    Journal journal;
+    journal.file_ = std::fopen(file_path.c_str(), "wb");
+    if (journal.file_ == NULL)
+      throw Error("Journal::Write", "Unable to open \"" + file_path + "\".");
+    journal.file_path_ = file_path;
+    journal.sync_period_ = static_cast<int>(record.size()) + 1;
+
+    uint32_t version = version_;
+    std::string header("OPSJRNL", 8);
+    header.append(reinterpret_cast<const char*>(&version), sizeof(version));
+    if (std::fwrite(header.data(), 1, header.size(), journal.file_)
+        != header.size())
+      throw Error("Journal::Write", "Failed to write in \"" + file_path
+                  + "\".");
+    for (std::size_t i = 0; i < record.size(); i++)
+      journal.Append(record[i].first, record[i].second);
+    journal.Close();
+  }
+
+
+}
+
+
+#define OPS_FILE_JOURNAL_CXX
+#endif
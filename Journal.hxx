@@ -0,0 +1,93 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+
+#ifndef OPS_FILE_JOURNAL_HXX
+
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace Ops
+{
+
+
+  //! Append-only binary log of the entries overridden in a configuration.
+  /*! Every record is an entry name and its value, in the format of
+    'Ops::Serialize'. The records are flushed to the disk every
+    'sync_period' records. See 'Ops::OpenJournal'.
+    The format is:
+    - the header: "OPSJRNL" followed by '\0' and the format version (32-bit
+    integer, which also identifies the byte order);
+    - the records: the length of the name (32-bit integer), the name, the
+    length of the value (64-bit integer) and the value.
+  */
+  class Journal
+  {
+  protected:
+    //! Path to the journal.
+    std::string file_path_;
+    //! The journal, open for appending, or NULL.
+    std::FILE* file_;
+    //! Number of records between two flushes to the disk.
+    int sync_period_;
+    //! Number of records between two compactions, or 0.
+    int compaction_period_;
+    //! Number of records not flushed to the disk.
+    int unsynced_;
+    //! Number of records appended since the last compaction.
+    int uncompacted_;
+    //! Version of the format.
+    static const uint32_t version_ = 1;
+
+  public:
+    // Constructor and destructor.
+    Journal();
+    ~Journal();
+
+    void Open(std::string file_path, int sync_period = 64,
+              int compaction_period = 0);
+    void Close();
+    bool IsOpen() const;
+    std::string GetFilePath() const;
+    void Append(const std::string& name, const std::string& value);
+    void Sync();
+    void Compact();
+
+    static std::vector<std::pair<std::string, std::string> >
+    Read(std::string file_path);
+    static std::vector<std::pair<std::string, std::string> >
+    Read(std::string file_path, std::size_t& end);
+    static void Write(std::string file_path,
+                      const std::vector<std::pair<std::string, std::string> >&
+                      record);
+
+  private:
+    Journal(const Journal&);
+    Journal& operator=(const Journal&);
+  };
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_JOURNAL_HXX
+#endif
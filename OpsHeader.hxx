@@ -32,8 +32,16 @@ extern "C"
 #include "lauxlib.h"
 }
 
-#ifndef OPS_WITH_EXCEPTION
-#define OPS_WITH_ABORT
+#if LUA_VERSION_NUM > 501
+#define OPS_LUA_RAWLEN lua_rawlen
+#else
+#define OPS_LUA_RAWLEN lua_objlen
+#endif
+
+#if LUA_VERSION_NUM > 502
+#define OPS_LUA_DUMP(state, writer, data) lua_dump(state, writer, data, 0)
+#else
+#define OPS_LUA_DUMP(state, writer, data) lua_dump(state, writer, data)
 #endif
 
 #ifndef DISP
@@ -41,15 +49,24 @@ extern "C"
 #endif
 
 #include <iostream>
+#include <climits>
+#include <cstdio>
+#include <cstring>
 #include <vector>
 #include <algorithm>
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <iomanip>
 #include <map>
+#include <memory>
 
 
 #include "Error.hxx"
+#include "OpsInstrumentation.hxx"
+#include "PhaseReport.hxx"
+#include "Profiler.hxx"
+#include "ReadEntries.hxx"
 #include "ClassOps.hxx"
 
 
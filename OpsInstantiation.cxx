@@ -0,0 +1,34 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+// This file instantiates the template methods declared 'extern template' in
+// "OpsInstantiation.hxx", for the compiled library.
+
+
+#ifndef OPS_FILE_OPSINSTANTIATION_CXX
+
+#include "OpsHeader.hxx"
+
+namespace Ops
+{
+  OPS_INSTANTIATE_ALL(template)
+}
+
+
+#define OPS_FILE_OPSINSTANTIATION_CXX
+#endif
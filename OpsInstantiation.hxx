@@ -0,0 +1,98 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_OPSINSTANTIATION_HXX
+
+// The template methods of 'Ops::Ops' for bool, int, float, double,
+// std::string and the vectors of these types are instantiated once in the
+// library ("OpsInstantiation.cxx"). They are declared here as 'extern
+// template', so that the clients neither instantiate them nor compile their
+// bodies. The other types are instantiated in the clients, as before. Define
+// OPS_NO_EXTERN_TEMPLATE to instantiate everything in the clients, e.g., when
+// the library is not linked.
+
+// 'prefix' is either "template" (explicit instantiation, in the library) or
+// "extern template" (explicit instantiation declaration, in the clients).
+#define OPS_INSTANTIATE_ELEMENT(prefix, type)                           \
+  prefix void Ops::Set(std::string, std::string, const type&, type&);   \
+  prefix void Ops::Set(std::string, std::string, type&);                \
+  prefix void Ops::Set(std::string, type&);                             \
+  prefix type Ops::Get(std::string);                                    \
+  prefix type Ops::Get(std::string, std::string);                       \
+  prefix type Ops::Get(std::string, std::string, const type&);          \
+  prefix type Ops::Apply(std::string, const type&);                     \
+  prefix type Ops::Apply(std::string, const type&, const type&);        \
+  prefix type Ops::Apply(std::string, const type&, const type&,         \
+                         const type&);                                  \
+  prefix type Ops::Apply(std::string, const type&, const type&,         \
+                         const type&, const type&);                     \
+  prefix type Ops::Apply(std::string, const type&, const type&,         \
+                         const type&, const type&, const type&);        \
+  prefix bool Ops::Is<type >(std::string);                              \
+  prefix void Ops::Override(std::string, const type&);
+
+#define OPS_INSTANTIATE_CROSSED_ELEMENT(prefix, type0, type1)           \
+  prefix void Ops::Apply(std::string, const std::vector<type0>&,        \
+                         std::vector<type1>&);
+
+#define OPS_INSTANTIATE_VECTOR(prefix, type)                            \
+  prefix void Ops::Set(std::string, std::string, const type&, type&);   \
+  prefix void Ops::Set(std::string, std::string, type&);                \
+  prefix void Ops::Set(std::string, type&);                             \
+  prefix type Ops::Get(std::string);                                    \
+  prefix type Ops::Get(std::string, std::string);                       \
+  prefix type Ops::Get(std::string, std::string, const type&);          \
+  prefix bool Ops::Is<type >(std::string);                              \
+  prefix void Ops::PushOnStack(const type&);                            \
+  prefix void Ops::Override(std::string, const type&);
+
+#define OPS_INSTANTIATE_CROSSED(prefix, type)                           \
+  OPS_INSTANTIATE_CROSSED_ELEMENT(prefix, bool, type)                   \
+  OPS_INSTANTIATE_CROSSED_ELEMENT(prefix, int, type)                    \
+  OPS_INSTANTIATE_CROSSED_ELEMENT(prefix, float, type)                  \
+  OPS_INSTANTIATE_CROSSED_ELEMENT(prefix, double, type)                 \
+  OPS_INSTANTIATE_CROSSED_ELEMENT(prefix, std::string, type)
+
+#define OPS_INSTANTIATE_ALL(prefix)                     \
+  OPS_INSTANTIATE_ELEMENT(prefix, bool)                 \
+  OPS_INSTANTIATE_ELEMENT(prefix, int)                  \
+  OPS_INSTANTIATE_ELEMENT(prefix, float)                \
+  OPS_INSTANTIATE_ELEMENT(prefix, double)               \
+  OPS_INSTANTIATE_ELEMENT(prefix, std::string)          \
+  OPS_INSTANTIATE_CROSSED(prefix, bool)                 \
+  OPS_INSTANTIATE_CROSSED(prefix, int)                  \
+  OPS_INSTANTIATE_CROSSED(prefix, float)                \
+  OPS_INSTANTIATE_CROSSED(prefix, double)               \
+  OPS_INSTANTIATE_CROSSED(prefix, std::string)          \
+  OPS_INSTANTIATE_VECTOR(prefix, std::vector<bool>)     \
+  OPS_INSTANTIATE_VECTOR(prefix, std::vector<int>)      \
+  OPS_INSTANTIATE_VECTOR(prefix, std::vector<float>)    \
+  OPS_INSTANTIATE_VECTOR(prefix, std::vector<double>)   \
+  OPS_INSTANTIATE_VECTOR(prefix, std::vector<std::string>)
+
+
+#ifndef OPS_NO_EXTERN_TEMPLATE
+namespace Ops
+{
+  OPS_INSTANTIATE_ALL(extern template)
+}
+#endif
+
+
+#define OPS_FILE_OPSINSTANTIATION_HXX
+#endif
@@ -0,0 +1,110 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_OPSINSTRUMENTATION_HXX
+
+// If OPS_WITH_INSTRUMENTATION is defined (for the library and its clients),
+// Ops calls 'InstrumentationBegin' and 'InstrumentationEnd' at the entry and
+// exit of its main operations. These two functions are not defined by Ops:
+// the user provides them at link time, e.g., to feed counters or trace spans
+// of a profiler. Otherwise, OPS_INSTRUMENT expands to nothing and the
+// instrumentation has no cost at all.
+
+#include <string>
+
+
+namespace Ops
+{
+
+
+  //! Operations reported to the instrumentation hooks.
+  enum InstrumentedOperation
+    {
+      //! 'Open' and 'Reload': the name is the file path.
+      instrument_open,
+      //! Resolution of an entry name on the Lua stack ('PutOnStack').
+      instrument_resolve,
+      //! Conversion of a Lua value to C++ ('Convert'). The name is empty if
+      //! the value is not an entry.
+      instrument_convert,
+      //! Evaluation of a constraint. The name is the entry or the value.
+      instrument_constraint,
+      //! Call to a Lua function ('Apply', 'ApplyArray').
+      instrument_apply,
+      //! 'Serialize': the name is the file path.
+      instrument_serialize,
+      //! 'Deserialize': the name is the file path, which is replaced by the
+      //! one stored in the buffer before the end hook is called.
+      instrument_deserialize
+    };
+
+
+#ifdef OPS_WITH_INSTRUMENTATION
+
+
+  // Hooks to be defined by the user.
+  void InstrumentationBegin(InstrumentedOperation operation,
+                            const std::string& name);
+  void InstrumentationEnd(InstrumentedOperation operation,
+                          const std::string& name);
+
+
+  //! Calls the instrumentation hooks at construction and destruction.
+  /*! The end hook is called even if the operation raises an exception.
+   */
+  class InstrumentationScope
+  {
+  private:
+    //! The instrumented operation.
+    InstrumentedOperation operation_;
+    //! Name of the entry, function or file. It must outlive the scope.
+    const std::string& name_;
+
+  public:
+    InstrumentationScope(InstrumentedOperation operation,
+                         const std::string& name):
+      operation_(operation), name_(name)
+    {
+      InstrumentationBegin(operation_, name_);
+    }
+
+    ~InstrumentationScope()
+    {
+      InstrumentationEnd(operation_, name_);
+    }
+  };
+
+
+#define OPS_INSTRUMENT(operation, name)                                 \
+  ::Ops::InstrumentationScope ops_instrumentation_scope(operation, name)
+
+
+#else
+
+
+#define OPS_INSTRUMENT(operation, name)
+
+
+#endif
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_OPSINSTRUMENTATION_HXX
+#endif
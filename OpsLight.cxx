@@ -0,0 +1,452 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_OPSLIGHT_CXX
+
+
+#include "OpsHeader.hxx"
+#include "OpsLight.hxx"
+
+
+namespace Ops
+{
+
+
+  /////////////////////////////////
+  // CONSTRUCTORS AND DESTRUCTOR //
+  /////////////////////////////////
+
+
+  //! Default constructor.
+  /*! A Lua state is opened.
+   */
+  OpsLight::OpsLight():
+    ops_(new Ops)
+  {
+  }
+
+
+  //! Main constructor.
+  /*! The Lua configuration file is loaded and run.
+    \param[in] file_path path to the configuration file.
+  */
+  OpsLight::OpsLight(std::string file_path):
+    ops_(new Ops(file_path))
+  {
+  }
+
+
+  //! Destructor.
+  OpsLight::~OpsLight()
+  {
+    delete ops_;
+  }
+
+
+  //////////////////
+  // MAIN METHODS //
+  //////////////////
+
+
+  //! Opens a new configuration file.
+  /*! See 'Ops::Open'.
+    \param[in] file_path path to the configuration file.
+    \param[in] close_state should the current Lua state be closed?
+  */
+  void OpsLight::Open(std::string file_path, bool close_state)
+  {
+    ops_->Open(file_path, close_state);
+  }
+
+
+  //! Reloads the current configuration file.
+  /*! See 'Ops::Reload'.
+    \param[in] close_state should the current Lua state be closed?
+  */
+  void OpsLight::Reload(bool close_state)
+  {
+    ops_->Reload(close_state);
+  }
+
+
+  //! Closes the Lua state.
+  void OpsLight::Close()
+  {
+    ops_->Close();
+  }
+
+
+  //! Retrieves a value and checks if it satisfies given constraints.
+  /*! See 'Ops::Set'.
+    \param[in] name name of the entry.
+    \param[in] constraint constraint to be satisfied.
+    \param[in] default_value default value for the entry in case it is not
+    found in the configuration file.
+    \param[out] value value of the entry.
+  */
+  template<class T>
+  void OpsLight::Set(std::string name, std::string constraint,
+                     const T& default_value, T& value)
+  {
+    ops_->Set(name, constraint, default_value, value);
+  }
+
+
+  //! Retrieves a value and checks if it satisfies given constraints.
+  /*! See 'Ops::Set'.
+    \param[in] name name of the entry.
+    \param[in] constraint constraint to be satisfied.
+    \param[out] value value of the entry.
+  */
+  template<class T>
+  void OpsLight::Set(std::string name, std::string constraint, T& value)
+  {
+    ops_->Set(name, constraint, value);
+  }
+
+
+  //! Retrieves a value.
+  /*! See 'Ops::Set'.
+    \param[in] name name of the entry.
+    \param[out] value value of the entry.
+  */
+  template<class T>
+  void OpsLight::Set(std::string name, T& value)
+  {
+    ops_->Set(name, value);
+  }
+
+
+  //! Retrieves a value.
+  /*! See 'Ops::Get'.
+    \param[in] name name of the entry.
+    \return The value of the entry.
+  */
+  template<class T>
+  T OpsLight::Get(std::string name)
+  {
+    return ops_->Get<T>(name);
+  }
+
+
+  //! Retrieves a value and checks if it satisfies given constraints.
+  /*! See 'Ops::Get'.
+    \param[in] name name of the entry.
+    \param[in] constraint constraint to be satisfied.
+    \return The value of the entry.
+  */
+  template<class T>
+  T OpsLight::Get(std::string name, std::string constraint)
+  {
+    return ops_->Get<T>(name, constraint);
+  }
+
+
+  //! Retrieves a value and checks if it satisfies given constraints.
+  /*! See 'Ops::Get'.
+    \param[in] name name of the entry.
+    \param[in] constraint constraint to be satisfied.
+    \param[in] default_value default value for the entry in case it is not
+    found in the configuration file.
+    \return The value of the entry.
+  */
+  template<class T>
+  T OpsLight::Get(std::string name, std::string constraint,
+                  const T& default_value)
+  {
+    return ops_->Get<T>(name, constraint, default_value);
+  }
+
+
+  //! Calls a Lua function.
+  /*! See 'Ops::Apply'.
+    \param[in] name name of the function.
+    \param[in] in input parameters.
+    \param[out] out outputs.
+  */
+  void OpsLight::Apply(std::string name, const std::vector<double>& in,
+                       std::vector<double>& out)
+  {
+    ops_->Apply(name, in, out);
+  }
+
+
+  //! Calls a Lua function with one argument.
+  /*!
+    \param[in] name name of the function.
+    \param[in] arg0 the argument.
+    \return The value returned by the function.
+  */
+  double OpsLight::Apply(std::string name, double arg0)
+  {
+    return ops_->Apply(name, arg0);
+  }
+
+
+  //! Calls a Lua function with two arguments.
+  /*!
+    \param[in] name name of the function.
+    \param[in] arg0 the first argument.
+    \param[in] arg1 the second argument.
+    \return The value returned by the function.
+  */
+  double OpsLight::Apply(std::string name, double arg0, double arg1)
+  {
+    return ops_->Apply(name, arg0, arg1);
+  }
+
+
+  //! Calls a Lua function with three arguments.
+  /*!
+    \param[in] name name of the function.
+    \param[in] arg0 the first argument.
+    \param[in] arg1 the second argument.
+    \param[in] arg2 the third argument.
+    \return The value returned by the function.
+  */
+  double OpsLight::Apply(std::string name, double arg0, double arg1,
+                         double arg2)
+  {
+    return ops_->Apply(name, arg0, arg1, arg2);
+  }
+
+
+  //! Returns the list of entries inside an entry.
+  /*!
+    \param[in] name the name of the table to search. If it is empty, the
+    global variables are listed.
+    \return The list of entries under \a name.
+  */
+  std::vector<std::string> OpsLight::GetEntryList(std::string name)
+  {
+    return ops_->GetEntryList(name);
+  }
+
+
+  //! Checks that an entry satisfies a constraint.
+  /*!
+    \param[in] name the name of the entry.
+    \param[in] constraint the constraint to be satisfied.
+    \return True if the constraint is satisfied, false otherwise.
+  */
+  bool OpsLight::CheckConstraint(std::string name, std::string constraint)
+  {
+    return ops_->CheckConstraint(name, constraint);
+  }
+
+
+  //! Checks whether an entry exists.
+  /*!
+    \param[in] name the name of the entry.
+    \return True if the entry exists, false otherwise.
+  */
+  bool OpsLight::Exists(std::string name)
+  {
+    return ops_->Exists(name);
+  }
+
+
+  //! Checks whether an entry has the type 'T'.
+  /*!
+    \param[in] name the name of the entry.
+    \return True if the entry is of type 'T', false otherwise.
+  */
+  template<class T>
+  bool OpsLight::Is(std::string name)
+  {
+    return ops_->Is<T>(name);
+  }
+
+
+  //! Checks whether an entry is a table.
+  /*!
+    \param[in] name the name of the entry.
+    \return True if the entry is a table, false otherwise.
+  */
+  bool OpsLight::IsTable(std::string name)
+  {
+    return ops_->IsTable(name);
+  }
+
+
+  //! Checks whether an entry is a function.
+  /*!
+    \param[in] name the name of the entry.
+    \return True if the entry is a function, false otherwise.
+  */
+  bool OpsLight::IsFunction(std::string name)
+  {
+    return ops_->IsFunction(name);
+  }
+
+
+  //! Executes a Lua file.
+  /*!
+    \param[in] file_path path to the Lua file.
+  */
+  void OpsLight::DoFile(std::string file_path)
+  {
+    ops_->DoFile(file_path);
+  }
+
+
+  //! Executes Lua code.
+  /*!
+    \param[in] expression the Lua code.
+  */
+  void OpsLight::DoString(std::string expression)
+  {
+    ops_->DoString(expression);
+  }
+
+
+  //! Serializes the evaluated entries.
+  /*! See 'Ops::Serialize'.
+    \return The binary buffer.
+  */
+  std::string OpsLight::Serialize()
+  {
+    return ops_->Serialize();
+  }
+
+
+  //! Restores entries serialized by 'Serialize'.
+  /*! See 'Ops::Deserialize'.
+    \param[in] buffer the binary buffer.
+  */
+  void OpsLight::Deserialize(const std::string& buffer)
+  {
+    ops_->Deserialize(buffer);
+  }
+
+
+  ////////////////////
+  // ACCESS METHODS //
+  ////////////////////
+
+
+  //! Returns the underlying configuration.
+  /*! The full interface requires "Ops.hxx".
+    \return The underlying 'Ops::Ops' object.
+  */
+  Ops& OpsLight::GetOps()
+  {
+    return *ops_;
+  }
+
+
+  //! Returns the path to the configuration file.
+  /*!
+    \return The path to the configuration file.
+  */
+  std::string OpsLight::GetFilePath() const
+  {
+    return ops_->GetFilePath();
+  }
+
+
+  //! Returns the prefix prepended to the entry names.
+  /*!
+    \return The prefix.
+  */
+  std::string OpsLight::GetPrefix() const
+  {
+    return ops_->GetPrefix();
+  }
+
+
+  //! Sets the prefix prepended to the entry names.
+  /*!
+    \param[in] prefix the prefix.
+  */
+  void OpsLight::SetPrefix(std::string prefix)
+  {
+    ops_->SetPrefix(prefix);
+  }
+
+
+  //! Clears the prefix prepended to the entry names.
+  void OpsLight::ClearPrefix()
+  {
+    ops_->ClearPrefix();
+  }
+
+
+  //! Returns the names of the entries read.
+  /*!
+    \return The names of the entries read.
+  */
+  std::vector<std::string> OpsLight::GetReadEntryList()
+  {
+    return ops_->GetReadEntryList();
+  }
+
+
+  //! Returns the Lua definitions of the entries read.
+  /*!
+    \return The Lua definitions of the entries read.
+  */
+  std::string OpsLight::LuaDefinition()
+  {
+    return ops_->LuaDefinition();
+  }
+
+
+  //! Writes the Lua definitions of the entries read in a file.
+  /*!
+    \param[in] file_name the output file.
+  */
+  void OpsLight::WriteLuaDefinition(std::string file_name)
+  {
+    ops_->WriteLuaDefinition(file_name);
+  }
+
+
+  ////////////////////////////
+  // EXPLICIT INSTANTIATION //
+  ////////////////////////////
+
+
+#define OPS_LIGHT_INSTANTIATE(T)                                        \
+  template void OpsLight::Set(std::string, std::string, const T&, T&);  \
+  template void OpsLight::Set(std::string, std::string, T&);            \
+  template void OpsLight::Set(std::string, T&);                         \
+  template T OpsLight::Get(std::string);                                \
+  template T OpsLight::Get(std::string, std::string);                   \
+  template T OpsLight::Get(std::string, std::string, const T&);         \
+  template bool OpsLight::Is<T>(std::string);
+
+  OPS_LIGHT_INSTANTIATE(bool)
+  OPS_LIGHT_INSTANTIATE(int)
+  OPS_LIGHT_INSTANTIATE(float)
+  OPS_LIGHT_INSTANTIATE(double)
+  OPS_LIGHT_INSTANTIATE(std::string)
+  OPS_LIGHT_INSTANTIATE(std::vector<bool>)
+  OPS_LIGHT_INSTANTIATE(std::vector<int>)
+  OPS_LIGHT_INSTANTIATE(std::vector<float>)
+  OPS_LIGHT_INSTANTIATE(std::vector<double>)
+  OPS_LIGHT_INSTANTIATE(std::vector<std::string>)
+
+#undef OPS_LIGHT_INSTANTIATE
+
+
+}
+
+
+#define OPS_FILE_OPSLIGHT_CXX
+#endif
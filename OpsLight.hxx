@@ -0,0 +1,113 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_OPSLIGHT_HXX
+
+// This header is an alternative to "Ops.hxx" for the translation units that
+// only read parameters. It does not include Lua nor the templates of
+// 'Ops::Ops', which are compiled once in the library. The types supported by
+// 'Get' and 'Set' are bool, int, float, double, std::string and the vectors
+// of these types.
+
+#include <string>
+#include <vector>
+
+#include "Error.hxx"
+
+
+namespace Ops
+{
+
+
+  class Ops;
+
+
+  //! Configuration with a compiled implementation.
+  /*! This class forwards to an 'Ops::Ops' object that is hidden from the
+    clients. Hence the clients need not be recompiled when the
+    implementation changes.
+  */
+  class OpsLight
+  {
+  private:
+    //! The underlying configuration.
+    Ops* ops_;
+
+  public:
+    // Constructors and destructor.
+    OpsLight();
+    explicit OpsLight(std::string file_path);
+    ~OpsLight();
+
+    // Main methods.
+    void Open(std::string file_path, bool close_state = true);
+    void Reload(bool close_state = true);
+    void Close();
+    template<class T>
+    void Set(std::string name, std::string constraint,
+             const T& default_value, T& value);
+    template<class T>
+    void Set(std::string name, std::string constraint, T& value);
+    template<class T>
+    void Set(std::string name, T& value);
+    template<class T>
+    T Get(std::string name);
+    template<class T>
+    T Get(std::string name, std::string constraint);
+    template<class T>
+    T Get(std::string name, std::string constraint, const T& default_value);
+    void Apply(std::string name, const std::vector<double>& in,
+               std::vector<double>& out);
+    double Apply(std::string name, double arg0);
+    double Apply(std::string name, double arg0, double arg1);
+    double Apply(std::string name, double arg0, double arg1, double arg2);
+    std::vector<std::string> GetEntryList(std::string name = "");
+    bool CheckConstraint(std::string name, std::string constraint);
+    bool Exists(std::string name);
+    template<class T>
+    bool Is(std::string name);
+    bool IsTable(std::string name);
+    bool IsFunction(std::string name);
+
+    void DoFile(std::string file_path);
+    void DoString(std::string expression);
+
+    std::string Serialize();
+    void Deserialize(const std::string& buffer);
+
+    // Access methods.
+    Ops& GetOps();
+    std::string GetFilePath() const;
+    std::string GetPrefix() const;
+    void SetPrefix(std::string prefix);
+    void ClearPrefix();
+    std::vector<std::string> GetReadEntryList();
+    std::string LuaDefinition();
+    void WriteLuaDefinition(std::string file_name);
+
+  private:
+    OpsLight(const OpsLight&);
+    OpsLight& operator=(const OpsLight&);
+  };
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_OPSLIGHT_HXX
+#endif
@@ -0,0 +1,216 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_PHASEREPORT_CXX
+
+
+#include "OpsHeader.hxx"
+#include "PhaseReport.hxx"
+
+
+namespace Ops
+{
+
+
+  //! Main constructor.
+  /*!
+    \param[in] name name of the phase.
+  */
+  PhaseReport::PhaseReport(std::string name):
+    name_(name), time_(0.), memory_begin_(0), memory_end_(0)
+  {
+  }
+
+
+  //! Starts the phase.
+  /*!
+    \param[in] memory memory used by Lua, in bytes.
+  */
+  void PhaseReport::Begin(long memory)
+  {
+    memory_begin_ = memory;
+    start_ = std::chrono::steady_clock::now();
+  }
+
+
+  //! Ends the phase.
+  /*!
+    \param[in] memory memory used by Lua, in bytes.
+  */
+  void PhaseReport::End(long memory)
+  {
+    std::chrono::duration<double> duration
+      = std::chrono::steady_clock::now() - start_;
+    time_ = duration.count();
+    memory_end_ = memory;
+  }
+
+
+  //! Appends a sub-phase.
+  /*!
+    \param[in] name name of the sub-phase.
+    \return The sub-phase. The reference is invalidated by the next call to
+    'AddChild'.
+  */
+  PhaseReport& PhaseReport::AddChild(std::string name)
+  {
+    children_.push_back(PhaseReport(name));
+    return children_.back();
+  }
+
+
+  //! Returns the name of the phase.
+  /*!
+    \return The name of the phase.
+  */
+  std::string PhaseReport::GetName() const
+  {
+    return name_;
+  }
+
+
+  //! Returns the wall time of the phase.
+  /*!
+    \return The wall time in seconds.
+  */
+  double PhaseReport::GetTime() const
+  {
+    return time_;
+  }
+
+
+  //! Returns the memory used by Lua at the beginning of the phase.
+  /*!
+    \return The memory in bytes.
+  */
+  long PhaseReport::GetMemoryBegin() const
+  {
+    return memory_begin_;
+  }
+
+
+  //! Returns the memory used by Lua at the end of the phase.
+  /*!
+    \return The memory in bytes.
+  */
+  long PhaseReport::GetMemoryEnd() const
+  {
+    return memory_end_;
+  }
+
+
+  //! Returns the sub-phases.
+  /*!
+    \return The sub-phases, in chronological order.
+  */
+  const std::vector<PhaseReport>& PhaseReport::GetChildren() const
+  {
+    return children_;
+  }
+
+
+  //! Returns the report as an indented table.
+  /*! Each line shows a phase with its wall time, the memory used by Lua at
+    its end and the memory variation during the phase.
+    \return The report.
+  */
+  std::string PhaseReport::Str() const
+  {
+    std::string output;
+    Str("", output);
+    return output;
+  }
+
+
+  //! Returns the report in JSON.
+  /*! Every phase is an object with the fields "name", "time" (in seconds),
+    "memory_begin" and "memory_end" (in bytes), and "children" (the array of
+    sub-phases).
+    \return The report.
+  */
+  std::string PhaseReport::Json() const
+  {
+    std::string output;
+    Json("", output);
+    return output + "\n";
+  }
+
+
+  //! Appends the report to a string, as an indented table.
+  /*!
+    \param[in] indent indentation of the phase.
+    \param[in,out] output the string to which the report is appended.
+  */
+  void PhaseReport::Str(std::string indent, std::string& output) const
+  {
+    std::ostringstream line;
+    line.setf(std::ios::fixed);
+    line << std::left << std::setw(48) << indent + name_ << std::right
+         << std::setprecision(3) << std::setw(12) << 1.e3 * time_ << " ms"
+         << std::setprecision(1) << std::setw(12) << memory_end_ / 1024.
+         << " kB" << std::showpos << std::setw(12)
+         << (memory_end_ - memory_begin_) / 1024. << " kB\n";
+    output += line.str();
+    for (std::size_t i = 0; i < children_.size(); i++)
+      children_[i].Str(indent + "  ", output);
+  }
+
+
+  //! Appends the report to a string, in JSON.
+  /*!
+    \param[in] indent indentation of the phase.
+    \param[in,out] output the string to which the report is appended.
+  */
+  void PhaseReport::Json(std::string indent, std::string& output) const
+  {
+    std::string name;
+    for (std::size_t i = 0; i < name_.size(); i++)
+      if (name_[i] == '"' || name_[i] == '\\')
+        name += std::string("\\") + name_[i];
+      else if (static_cast<unsigned char>(name_[i]) < 0x20)
+        {
+          char code[8];
+          std::snprintf(code, sizeof(code), "\\u%04x",
+                        static_cast<unsigned char>(name_[i]));
+          name += code;
+        }
+      else
+        name += name_[i];
+
+    std::ostringstream object;
+    object.precision(9);
+    object << indent << "{\"name\": \"" << name << "\", \"time\": " << time_
+           << ", \"memory_begin\": " << memory_begin_
+           << ", \"memory_end\": " << memory_end_ << ", \"children\": [";
+    output += object.str();
+    for (std::size_t i = 0; i < children_.size(); i++)
+      {
+        output += i == 0 ? "\n" : ",\n";
+        children_[i].Json(indent + "  ", output);
+      }
+    if (!children_.empty())
+      output += "\n" + indent;
+    output += "]}";
+  }
+
+
+}
+
+
+#define OPS_FILE_PHASEREPORT_CXX
+#endif
@@ -0,0 +1,79 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_PHASEREPORT_HXX
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+namespace Ops
+{
+
+
+  //! Wall time and Lua memory of a phase, with its sub-phases.
+  /*! See 'Ops::OpenReport'.
+   */
+  class PhaseReport
+  {
+  protected:
+    //! Name of the phase.
+    std::string name_;
+    //! Wall time in seconds.
+    double time_;
+    //! Memory used by Lua at the beginning of the phase, in bytes.
+    long memory_begin_;
+    //! Memory used by Lua at the end of the phase, in bytes.
+    long memory_end_;
+    //! Sub-phases, in chronological order.
+    std::vector<PhaseReport> children_;
+#ifndef SWIG
+    //! Time at the beginning of the phase.
+    std::chrono::steady_clock::time_point start_;
+#endif
+
+  public:
+    // Constructor.
+    explicit PhaseReport(std::string name = "");
+
+    void Begin(long memory);
+    void End(long memory);
+    PhaseReport& AddChild(std::string name);
+
+    // Access methods.
+    std::string GetName() const;
+    double GetTime() const;
+    long GetMemoryBegin() const;
+    long GetMemoryEnd() const;
+    const std::vector<PhaseReport>& GetChildren() const;
+
+    std::string Str() const;
+    std::string Json() const;
+
+  protected:
+    void Str(std::string indent, std::string& output) const;
+    void Json(std::string indent, std::string& output) const;
+  };
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_PHASEREPORT_HXX
+#endif
@@ -0,0 +1,259 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+
+#ifndef OPS_FILE_PREDICATE_HXX
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace Ops
+{
+
+
+  //! Constraint evaluated in C++, with its description.
+  /*! A predicate takes a value (or an element, for vectors) and returns true
+    if the value satisfies the constraint. Its description, written like a
+    Lua constraint (e.g., "v >= 0 and v <= 1"), is used in the error
+    messages. The predicates are built with 'Satisfies', 'Range' and 'OneOf',
+    and combined with '&&', '||' and '!'. See 'Ops::Get'.
+  */
+  template<class F>
+  class Predicate
+  {
+  protected:
+    //! The test.
+    F test_;
+    //! Description of the test.
+    std::string description_;
+
+  public:
+    Predicate(F test, std::string description):
+      test_(std::move(test)), description_(std::move(description))
+    {
+    }
+
+    template<class T>
+    auto operator()(const T& value) const
+      -> decltype(bool(std::declval<const F&>()(value)))
+    {
+      return bool(test_(value));
+    }
+
+    std::string GetDescription() const
+    {
+      return description_;
+    }
+  };
+
+
+  //! Builds a predicate from a callable and its description.
+  /*!
+    \param[in] test the callable, which returns true if its argument
+    satisfies the constraint.
+    \param[in] description the description of the constraint.
+    \return The predicate.
+  */
+  template<class F>
+  Predicate<F> Satisfies(F test, std::string description)
+  {
+    return Predicate<F>(std::move(test), std::move(description));
+  }
+
+
+  //! Writes a value in a description.
+  /*!
+    \param[in,out] output the stream.
+    \param[in] value the value.
+  */
+  template<class T>
+  void DescribeValue(std::ostream& output, const T& value)
+  {
+    output << value;
+  }
+
+
+  //! Writes a string, quoted, in a description.
+  /*!
+    \param[in,out] output the stream.
+    \param[in] value the string.
+  */
+  inline void DescribeValue(std::ostream& output, const std::string& value)
+  {
+    output << "'" << value << "'";
+  }
+
+
+  //! Writes a string, quoted, in a description.
+  /*!
+    \param[in,out] output the stream.
+    \param[in] value the string.
+  */
+  inline void DescribeValue(std::ostream& output, const char* value)
+  {
+    output << "'" << value << "'";
+  }
+
+
+  //! Predicate satisfied by the values in [lower, upper].
+  /*!
+    \param[in] lower the lower bound.
+    \param[in] upper the upper bound.
+    \return The predicate.
+  */
+  template<class TL, class TU>
+  auto Range(TL lower, TU upper)
+  {
+    std::ostringstream description;
+    description << "v >= ";
+    DescribeValue(description, lower);
+    description << " and v <= ";
+    DescribeValue(description, upper);
+    return Satisfies([lower, upper](const auto& v)
+                     {
+                       return v >= lower && v <= upper;
+                     }, description.str());
+  }
+
+
+  //! Predicate satisfied by the values of a list.
+  /*!
+    \param[in] value the acceptable values.
+    \return The predicate.
+  */
+  template<class... T>
+  auto OneOf(const T&... value)
+  {
+    typedef typename std::common_type
+      <typename std::decay<const T&>::type...>::type element_type;
+    std::vector<element_type> list = {value...};
+    std::ostringstream description;
+    description << "v in {";
+    for (std::size_t i = 0; i < list.size(); i++)
+      {
+        if (i != 0)
+          description << ", ";
+        DescribeValue(description, list[i]);
+      }
+    description << "}";
+    return Satisfies([list](const auto& v)
+                     {
+                       for (std::size_t i = 0; i < list.size(); i++)
+                         if (v == list[i])
+                           return true;
+                       return false;
+                     }, description.str());
+  }
+
+
+  //! Predicate satisfied when both predicates are satisfied.
+  template<class F1, class F2>
+  auto operator&&(const Predicate<F1>& first, const Predicate<F2>& second)
+  {
+    return Satisfies([first, second](const auto& v)
+                     {
+                       return first(v) && second(v);
+                     }, "(" + first.GetDescription() + ") and ("
+                     + second.GetDescription() + ")");
+  }
+
+
+  //! Predicate satisfied when either predicate is satisfied.
+  template<class F1, class F2>
+  auto operator||(const Predicate<F1>& first, const Predicate<F2>& second)
+  {
+    return Satisfies([first, second](const auto& v)
+                     {
+                       return first(v) || second(v);
+                     }, "(" + first.GetDescription() + ") or ("
+                     + second.GetDescription() + ")");
+  }
+
+
+  //! Predicate satisfied when a predicate is not satisfied.
+  template<class F>
+  auto operator!(const Predicate<F>& predicate)
+  {
+    return Satisfies([predicate](const auto& v)
+                     {
+                       return !predicate(v);
+                     }, "not (" + predicate.GetDescription() + ")");
+  }
+
+
+  //! Returns the description of a predicate.
+  /*!
+    \param[in] predicate the predicate.
+    \return The description.
+  */
+  template<class F>
+  std::string DescribePredicate(const Predicate<F>& predicate)
+  {
+    return predicate.GetDescription();
+  }
+
+
+  //! Returns the description of a callable without description.
+  /*!
+    \return A generic description.
+  */
+  template<class F>
+  std::string DescribePredicate(const F&)
+  {
+    return "<C++ predicate>";
+  }
+
+
+  //! Type of the argument of a predicate on a value of type T.
+  template<class T>
+  struct PredicateArgument
+  {
+    typedef T type;
+  };
+
+
+  //! Type of the argument of a predicate on a vector: its element.
+  template<class T>
+  struct PredicateArgument<std::vector<T> >
+  {
+    typedef T type;
+  };
+
+
+  //! Is F a predicate (and not a Lua constraint) on a value of type T?
+  template<class F, class T>
+  struct IsPredicate:
+    std::integral_constant<bool, !std::is_convertible<F, std::string>::value
+                           && std::is_invocable_r<bool, const F&, const
+                                                  typename
+                                                  PredicateArgument<T>::type&>
+                           ::value>
+  {
+  };
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_PREDICATE_HXX
+#endif
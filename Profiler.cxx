@@ -0,0 +1,262 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_PROFILER_CXX
+
+
+#include "OpsHeader.hxx"
+#include "Profiler.hxx"
+
+
+namespace Ops
+{
+
+
+  char Profiler::registry_key_ = 0;
+
+
+  //! Default constructor.
+  /*! The profiler is inactive.
+   */
+  Profiler::Profiler():
+    period_(0)
+  {
+  }
+
+
+  //! Activates the profiler.
+  /*! The hook is installed by 'Attach'.
+    \param[in] period number of Lua instructions between two samples.
+  */
+  void Profiler::Start(int period)
+  {
+    if (period <= 0)
+      throw Error("Profiler::Start", "The period must be positive.");
+    period_ = period;
+  }
+
+
+  //! Deactivates the profiler.
+  /*! The hook is removed by 'Attach'. The samples are kept.
+   */
+  void Profiler::Stop()
+  {
+    period_ = 0;
+  }
+
+
+  //! Is the profiler active?
+  /*!
+    \return True if the profiler is active, false otherwise.
+  */
+  bool Profiler::IsActive() const
+  {
+    return period_ > 0;
+  }
+
+
+  //! Discards all samples.
+  void Profiler::Clear()
+  {
+    stack_count_.clear();
+    line_count_.clear();
+  }
+
+
+  //! Returns the number of samples.
+  /*!
+    \return The number of samples.
+  */
+  long Profiler::GetSampleCount() const
+  {
+    long count = 0;
+    for (std::map<std::string, long>::const_iterator i = stack_count_.begin();
+         i != stack_count_.end(); ++i)
+      count += i->second;
+    return count;
+  }
+
+
+  //! Returns the samples as folded stacks.
+  /*! Each line contains the context and the Lua functions, from the
+    outermost one, separated by ';', followed by the number of samples. Every
+    function is given with its source and current line. This is the input
+    format of flame graph tools (e.g., "flamegraph.pl").
+    \return The folded stacks.
+  */
+  std::string Profiler::Folded() const
+  {
+    std::ostringstream output;
+    for (std::map<std::string, long>::const_iterator i = stack_count_.begin();
+         i != stack_count_.end(); ++i)
+      output << i->first << " " << i->second << "\n";
+    return output.str();
+  }
+
+
+  //! Returns the number of samples of each line, for each context.
+  /*! In each context, the lines are sorted by decreasing number of samples.
+    A line is attributed a sample when it is being executed, not when it
+    calls the function being executed.
+    \return The report.
+  */
+  std::string Profiler::Str() const
+  {
+    std::ostringstream output;
+    output.setf(std::ios::fixed);
+    output.precision(1);
+    std::map<std::string, std::map<std::string, long> >::const_iterator i;
+    for (i = line_count_.begin(); i != line_count_.end(); ++i)
+      {
+        std::vector<std::pair<long, std::string> > line;
+        long total = 0;
+        std::map<std::string, long>::const_iterator j;
+        for (j = i->second.begin(); j != i->second.end(); ++j)
+          {
+            line.push_back(std::make_pair(-j->second, j->first));
+            total += j->second;
+          }
+        std::sort(line.begin(), line.end());
+
+        output << i->first << " (" << total << " samples)\n";
+        for (std::size_t k = 0; k < line.size(); k++)
+          output << std::setw(8) << -100. * line[k].first / total << "% "
+                 << std::setw(8) << -line[k].first << "  " << line[k].second
+                 << "\n";
+      }
+    return output.str();
+  }
+
+
+  //! Installs or removes the hook in a Lua state.
+  /*! The hook is installed if the profiler is active, and removed otherwise.
+    \param[in] state the Lua state.
+  */
+  void Profiler::Attach(lua_State* state)
+  {
+    lua_pushlightuserdata(state, &registry_key_);
+    if (IsActive())
+      lua_pushlightuserdata(state, this);
+    else
+      lua_pushnil(state);
+    lua_rawset(state, LUA_REGISTRYINDEX);
+
+    if (IsActive())
+      lua_sethook(state, Hook, LUA_MASKCOUNT, period_);
+    else
+      lua_sethook(state, NULL, 0, 0);
+  }
+
+
+  //! Returns the current context.
+  /*!
+    \return The current context.
+  */
+  std::string Profiler::GetContext() const
+  {
+    return context_;
+  }
+
+
+  //! Sets the current context.
+  /*!
+    \param[in] context the new context.
+  */
+  void Profiler::SetContext(const std::string& context)
+  {
+    context_ = context;
+  }
+
+
+  //! Records the call stack of a Lua state.
+  /*!
+    \param[in] state the Lua state.
+  */
+  void Profiler::Sample(lua_State* state)
+  {
+    std::vector<std::string> frame;
+    lua_Debug debug;
+    for (int level = 0; lua_getstack(state, level, &debug); level++)
+      {
+        lua_getinfo(state, "nSl", &debug);
+        std::string name;
+        if (debug.name != NULL)
+          name = debug.name;
+        else if (std::strcmp(debug.what, "main") == 0)
+          name = "main chunk";
+        else
+          {
+            // E.g., a function called by 'Apply'.
+            std::ostringstream anonymous;
+            anonymous << "function@" << debug.linedefined;
+            name = anonymous.str();
+          }
+        if (std::strcmp(debug.what, "C") == 0)
+          frame.push_back("[C] " + name);
+        else
+          {
+            std::ostringstream label;
+            label << name << " (" << debug.short_src << ":"
+                  << debug.currentline << ")";
+            frame.push_back(label.str());
+          }
+        // ';' separates the frames in the folded format.
+        std::replace(frame.back().begin(), frame.back().end(), ';', ',');
+      }
+    if (frame.empty())
+      return;
+
+    std::string context = context_.empty() ? "Lua" : context_;
+    std::replace(context.begin(), context.end(), ';', ',');
+    std::string stack = context;
+    for (std::size_t i = frame.size(); i > 0; i--)
+      stack += ";" + frame[i - 1];
+    stack_count_[stack]++;
+    line_count_[context][frame[0]]++;
+  }
+
+
+  //! Count hook called by Lua.
+  /*!
+    \param[in] state the Lua state.
+    \param[in] debug information about the running function (unused).
+  */
+  void Profiler::Hook(lua_State* state, lua_Debug* /* debug */)
+  {
+    lua_pushlightuserdata(state, &registry_key_);
+    lua_rawget(state, LUA_REGISTRYINDEX);
+    Profiler* profiler = static_cast<Profiler*>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+    if (profiler == NULL)
+      return;
+    // No exception may cross the Lua interpreter.
+    try
+      {
+        profiler->Sample(state);
+      }
+    catch(...)
+      {
+      }
+  }
+
+
+}
+
+
+#define OPS_FILE_PROFILER_CXX
+#endif
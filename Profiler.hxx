@@ -0,0 +1,112 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_PROFILER_HXX
+
+#include <map>
+#include <string>
+
+
+namespace Ops
+{
+
+
+  //! Sampling profiler of the Lua code run by Ops.
+  /*! Every 'period' Lua instructions, a count hook records the Lua call
+    stack, with the current line of every function. The samples are
+    attributed to a context: the configuration file during 'Open', the
+    function called by 'Apply', or the entry whose constraint is checked.
+    See 'Ops::StartProfiler'.
+  */
+  class Profiler
+  {
+  protected:
+    //! Number of Lua instructions between two samples, or 0 if inactive.
+    int period_;
+    //! Current context.
+    std::string context_;
+    //! Number of samples of each call stack, in folded format.
+    std::map<std::string, long> stack_count_;
+    //! Number of samples of each line, for each context.
+    std::map<std::string, std::map<std::string, long> > line_count_;
+    //! Address used as a key in the Lua registry.
+    static char registry_key_;
+
+  public:
+    // Constructor.
+    Profiler();
+
+    void Start(int period);
+    void Stop();
+    bool IsActive() const;
+    void Clear();
+    long GetSampleCount() const;
+    std::string Folded() const;
+    std::string Str() const;
+
+#ifndef SWIG
+    void Attach(lua_State* state);
+    std::string GetContext() const;
+    void SetContext(const std::string& context);
+    void Sample(lua_State* state);
+    static void Hook(lua_State* state, lua_Debug* debug);
+#endif
+  };
+
+
+#ifndef SWIG
+  //! Sets the context of a profiler in a scope.
+  /*! The previous context is restored on destruction, even if an exception
+    is raised. Nothing is done if the profiler is inactive.
+  */
+  class ProfilerContext
+  {
+  private:
+    //! The profiler.
+    Profiler& profiler_;
+    //! Has the context been changed?
+    bool active_;
+    //! The previous context.
+    std::string previous_;
+
+  public:
+    ProfilerContext(Profiler& profiler, const char* kind,
+                    const std::string& name):
+      profiler_(profiler), active_(profiler.IsActive())
+    {
+      if (active_)
+        {
+          previous_ = profiler_.GetContext();
+          profiler_.SetContext(std::string(kind) + " " + name);
+        }
+    }
+
+    ~ProfilerContext()
+    {
+      if (active_)
+        profiler_.SetContext(previous_);
+    }
+  };
+#endif
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_PROFILER_HXX
+#endif
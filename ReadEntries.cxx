@@ -0,0 +1,331 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_READENTRIES_CXX
+
+
+#include "OpsHeader.hxx"
+#include "ReadEntries.hxx"
+
+#include <thread>
+
+
+namespace Ops
+{
+
+
+  //! Discards all entries.
+  void ReadEntries::Clear()
+  {
+    read_bool.clear();
+    read_int.clear();
+    read_float.clear();
+    read_double.clear();
+    read_string.clear();
+    read_vect_bool.clear();
+    read_vect_int.clear();
+    read_vect_float.clear();
+    read_vect_double.clear();
+    read_vect_string.clear();
+  }
+
+
+  //! Returns the list of the entry names.
+  /*!
+    \return The list of the entries, sorted.
+  */
+  std::vector<std::string> ReadEntries::GetEntryList() const
+  {
+    std::vector<std::string> name_list;
+    AppendKey(read_bool, name_list);
+    AppendKey(read_int, name_list);
+    AppendKey(read_float, name_list);
+    AppendKey(read_double, name_list);
+    AppendKey(read_string, name_list);
+    AppendKey(read_vect_bool, name_list);
+    AppendKey(read_vect_int, name_list);
+    AppendKey(read_vect_float, name_list);
+    AppendKey(read_vect_double, name_list);
+    AppendKey(read_vect_string, name_list);
+
+    sort(name_list.begin(), name_list.end());
+    name_list.erase(std::unique(name_list.begin(), name_list.end()),
+                    name_list.end());
+
+    return name_list;
+  }
+
+
+  //! Returns a Lua line that defines an entry.
+  /*!
+    \param[in] name name of the entry.
+    \return A Lua line that defines \a name. It is in the form "name = value".
+    It is empty if \a name was not read.
+  */
+  std::string ReadEntries::LuaDefinition(const std::string& name) const
+  {
+    std::ostringstream output;
+
+    // Below, the name is searched in all maps. When the name is found, its
+    // value is converted to a std::string (that Lua can process).
+
+    std::map<std::string, bool>::const_iterator i_bool = read_bool.find(name);
+    if (i_bool != read_bool.end())
+    {
+      if (i_bool->second)
+        output << name << " = true";
+      else
+        output << name << " = false";
+    }
+    // In case the entry was read under two different types, only one type is
+    // returned. So, once the entry is found, this method returns the
+    // definition.
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, int>::const_iterator i_int = read_int.find(name);
+    if (i_int != read_int.end())
+      output << name << " = " << i_int->second;
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, float>::const_iterator i_float
+      = read_float.find(name);
+    if (i_float != read_float.end())
+      output << name << " = " << i_float->second;
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, double>::const_iterator i_double
+      = read_double.find(name);
+    if (i_double != read_double.end())
+      output << name << " = " << i_double->second;
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, std::string>::const_iterator i_string
+      = read_string.find(name);
+    if (i_string != read_string.end())
+      output << name << " = \"" << i_string->second << "\"";
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, std::vector<bool> >::const_iterator i_vect_bool
+      = read_vect_bool.find(name);
+    if (i_vect_bool != read_vect_bool.end())
+      {
+        output << name << " = {";
+        std::size_t size = i_vect_bool->second.size();
+
+        if (size != 0)
+          {
+            for (std::size_t i = 0; i < size - 1; i++)
+              if (i_vect_bool->second[i])
+                output << "true, ";
+              else
+                output << "false, ";
+
+            if (i_vect_bool->second[size - 1])
+              output << "true";
+            else
+              output << "false";
+          }
+
+        output << "}";
+      }
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, std::vector<int> >::const_iterator i_vect_int
+      = read_vect_int.find(name);
+    if (i_vect_int != read_vect_int.end())
+      {
+        output << name << " = {";
+        std::size_t size = i_vect_int->second.size();
+
+        if (size != 0)
+          {
+            for (std::size_t i = 0; i < size - 1; i++)
+              output << i_vect_int->second[i] << ", ";
+            output << i_vect_int->second[size - 1];
+          }
+        output << "}";
+      }
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, std::vector<float> >::const_iterator i_vect_float
+      = read_vect_float.find(name);
+    if (i_vect_float != read_vect_float.end())
+      {
+        output << name << " = {";
+        std::size_t size = i_vect_float->second.size();
+
+        if (size != 0)
+          {
+            for (std::size_t i = 0; i < size - 1; i++)
+              output << i_vect_float->second[i] << ", ";
+            output << i_vect_float->second[size - 1];
+          }
+        output << "}";
+      }
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, std::vector<double> >::const_iterator i_vect_double
+      = read_vect_double.find(name);
+    if (i_vect_double != read_vect_double.end())
+      {
+        output << name << " = {";
+        std::size_t size = i_vect_double->second.size();
+
+        if (size != 0)
+          {
+            for (std::size_t i = 0; i < size - 1; i++)
+              output << i_vect_double->second[i] << ", ";
+            output << i_vect_double->second[size - 1];
+          }
+        output << "}";
+      }
+    if (!output.str().empty())
+      return output.str();
+
+    std::map<std::string, std::vector<std::string> >::const_iterator
+      i_vect_string = read_vect_string.find(name);
+    if (i_vect_string != read_vect_string.end())
+      {
+        output << name << " = {";
+        std::size_t size = i_vect_string->second.size();
+
+        if (size != 0)
+          {
+            for (std::size_t i = 0; i < size - 1; i++)
+              output << "\"" << i_vect_string->second[i] << "\", ";
+            output << "\"" << i_vect_string->second[size - 1] << "\"";
+          }
+        output << "}";
+      }
+    if (!output.str().empty())
+      return output.str();
+
+    return output.str();
+  }
+
+
+  //! Returns the Lua definitions of all read variables.
+  /*! The variables are returned in alphabetical order.
+    \return The Lua definitions of all read variables.
+  */
+  std::string ReadEntries::LuaDefinition() const
+  {
+    std::vector<std::string> name_list = GetEntryList();
+
+    std::string output;
+    std::vector<std::string>::const_iterator name;
+    std::string previous_name = "";
+    for (name = name_list.begin(); name != name_list.end(); name++)
+      {
+        // If '*name' is (or is part of) a new variable, inserts a new
+        // line. Otherwise, '*name' is part of a table being written, so no
+        // newline should be inserted.
+        if (!previous_name.empty()
+            && previous_name.substr(0, previous_name.find("."))
+            != name->substr(0, name->find(".")))
+          output += "\n";
+
+        // Checks whether a new table is introduced. In this case, it should
+        // be declared first, with "name = {}".
+        if (name->find_first_of(".[") != std::string::npos)
+          {
+            std::string::size_type i = 0;
+            std::string::size_type min_length
+              = std::min(name->size(), previous_name.size());
+            // Checks until where the previous name and the current name
+            // coincide.
+            while (i < min_length && previous_name[i] == (*name)[i])
+              i++;
+            if (i < min_length
+                && (previous_name[i] == '.' || previous_name[i] == '[')
+                && ((*name)[i] == '.' || (*name)[i] == '['))
+              i++;
+            while ((i = name->find_first_of(".[", i)) != std::string::npos)
+              output += name->substr(0, i++) + " = {}\n";
+          }
+
+        output += LuaDefinition(*name) + "\n";
+
+        previous_name = *name;
+      }
+
+    return output;
+  }
+
+
+  //! Writes the Lua definitions of all entries in a file.
+  /*! The definitions are written in a temporary file (in the same
+    directory), which is then renamed to \a file_name. Hence the file is
+    replaced atomically: it never contains partial definitions.
+    \param[in] file_name the name of the file in which the definitions are
+    written.
+  */
+  void ReadEntries::WriteLuaDefinition(const std::string& file_name) const
+  {
+    std::string error = TryWriteLuaDefinition(file_name);
+    if (!error.empty())
+      throw Error("WriteLuaDefinition", error);
+  }
+
+
+  //! Writes the Lua definitions of all entries in a file, without raising.
+  /*! The file is written as in 'WriteLuaDefinition', but no 'Error' is
+    constructed on failure, so that it can be called from another thread
+    even when 'Error' aborts (OPS_WITH_ABORT).
+    \param[in] file_name the name of the file in which the definitions are
+    written.
+    \return The error message, or an empty string if the file was written.
+  */
+  std::string
+  ReadEntries::TryWriteLuaDefinition(const std::string& file_name) const
+  {
+    std::ostringstream temporary;
+    temporary << file_name << ".tmp" << std::this_thread::get_id();
+    std::string temporary_name = temporary.str();
+
+    std::ofstream f(temporary_name.c_str());
+    f << LuaDefinition();
+    f.close();
+    if (!f.good())
+      {
+        std::remove(temporary_name.c_str());
+        return "Failed to write in \"" + temporary_name + "\".";
+      }
+    if (std::rename(temporary_name.c_str(), file_name.c_str()) != 0)
+      {
+        std::remove(temporary_name.c_str());
+        return "Failed to rename \"" + temporary_name + "\" to \""
+          + file_name + "\".";
+      }
+    return "";
+  }
+
+
+}
+
+
+#define OPS_FILE_READENTRIES_CXX
+#endif
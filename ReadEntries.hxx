@@ -0,0 +1,87 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_READENTRIES_HXX
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace Ops
+{
+
+
+  //! Names and values of the entries read in a configuration.
+  /*! 'Ops::Ops' shares its entries with the asynchronous writers (see
+    'Ops::WriteLuaDefinitionAsync'), and copies them before modifying them
+    once they have been handed out.
+  */
+  class ReadEntries
+  {
+  public:
+    //! Names and values of all Booleans read in the file.
+    std::map<std::string, bool> read_bool;
+    //! Names and values of all integer read in the file.
+    std::map<std::string, int> read_int;
+    //! Names and values of all floats read in the file.
+    std::map<std::string, float> read_float;
+    //! Names and values of all doubles read in the file.
+    std::map<std::string, double> read_double;
+    //! Names and values of all strings read in the file.
+    std::map<std::string, std::string> read_string;
+    //! Names and values of all vectors of Booleans read in the file.
+    std::map<std::string, std::vector<bool> > read_vect_bool;
+    //! Names and values of all vectors of integers read in the file.
+    std::map<std::string, std::vector<int> > read_vect_int;
+    //! Names and values of all vectors of floats read in the file.
+    std::map<std::string, std::vector<float> > read_vect_float;
+    //! Names and values of all vectors of doubles read in the file.
+    std::map<std::string, std::vector<double> > read_vect_double;
+    //! Names and values of all vectors of strings read in the file.
+    std::map<std::string, std::vector<std::string> > read_vect_string;
+
+    void Clear();
+    std::vector<std::string> GetEntryList() const;
+    std::string LuaDefinition(const std::string& name) const;
+    std::string LuaDefinition() const;
+    void WriteLuaDefinition(const std::string& file_name) const;
+    std::string TryWriteLuaDefinition(const std::string& file_name) const;
+
+  protected:
+    //! Pushes all keys of a map into a vector.
+    /*!
+      \param[in] input the map whose keys should be pushed.
+      \param[in,out] vect the vector to which the map keys are pushed back.
+    */
+    template<class TK, class T>
+    static void AppendKey(const std::map<TK, T>& input,
+                          std::vector<TK>& vect)
+    {
+      typename std::map<TK, T>::const_iterator i;
+      for (i = input.begin(); i != input.end(); i++)
+        vect.push_back(i->first);
+    }
+  };
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_READENTRIES_HXX
+#endif
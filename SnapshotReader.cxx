@@ -0,0 +1,791 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+
+#ifndef OPS_FILE_SNAPSHOTREADER_CXX
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "SnapshotReader.hxx"
+
+
+namespace Ops
+{
+
+
+  /////////////////////////////////
+  // CONSTRUCTORS AND DESTRUCTOR //
+  /////////////////////////////////
+
+
+  //! Default constructor.
+  /*! Nothing is done: no snapshot is opened.
+   */
+  SnapshotReader::SnapshotReader():
+    data_(NULL), size_(0), global_(0)
+  {
+  }
+
+
+  //! Main constructor.
+  /*! The snapshot is opened.
+    \param[in] snapshot_path path to the snapshot.
+  */
+  SnapshotReader::SnapshotReader(std::string snapshot_path):
+    data_(NULL), size_(0), global_(0)
+  {
+    Open(snapshot_path);
+  }
+
+
+  //! Destructor.
+  /*! The snapshot is unmapped.
+   */
+  SnapshotReader::~SnapshotReader()
+  {
+    Close();
+  }
+
+
+  //////////////////
+  // MAIN METHODS //
+  //////////////////
+
+
+  //! Opens a snapshot.
+  /*! The snapshot is mapped in memory (or read, if mapping is not available)
+    and its header is checked. The entries are read on demand.
+    \param[in] snapshot_path path to the snapshot, written by
+    'Ops::WriteSnapshot'.
+  */
+  void SnapshotReader::Open(std::string snapshot_path)
+  {
+    Close();
+
+#ifdef _WIN32
+    std::ifstream f(snapshot_path.c_str(), std::ios::binary);
+    if (!f.is_open())
+      throw Error("SnapshotReader::Open", "Unable to open \"" + snapshot_path
+                  + "\".");
+    buffer_.assign((std::istreambuf_iterator<char>(f)),
+                   std::istreambuf_iterator<char>());
+    if (f.bad())
+      throw Error("SnapshotReader::Open", "Failed to read \"" + snapshot_path
+                  + "\".");
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#else
+    int descriptor = open(snapshot_path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+      throw Error("SnapshotReader::Open", "Unable to open \"" + snapshot_path
+                  + "\".");
+    struct stat status;
+    if (fstat(descriptor, &status) != 0)
+      {
+        close(descriptor);
+        throw Error("SnapshotReader::Open", "Failed to read \""
+                    + snapshot_path + "\".");
+      }
+    size_ = static_cast<std::size_t>(status.st_size);
+    void* map = size_ == 0 ? MAP_FAILED
+      : mmap(NULL, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping remains valid after the file is closed.
+    close(descriptor);
+    if (map == MAP_FAILED)
+      {
+        size_ = 0;
+        throw Error("SnapshotReader::Open", "Failed to map \""
+                    + snapshot_path + "\" in memory.");
+      }
+    data_ = static_cast<const char*>(map);
+#endif
+    snapshot_path_ = snapshot_path;
+
+    if (size_ < 16 || std::memcmp(data_, "OPSSNAP", 8) != 0)
+      {
+        Close();
+        throw Error("SnapshotReader::Open", "\"" + snapshot_path
+                    + "\" is not a snapshot.");
+      }
+    // Version 1 has no functions, but is otherwise the same.
+    uint32_t version = ReadRaw<uint32_t>(8);
+    if (version != 1 && version != snapshot_version_)
+      {
+        Close();
+        throw Error("SnapshotReader::Open", "\"" + snapshot_path
+                    + "\" was written with an unsupported format or byte "
+                    "order.");
+      }
+    uint32_t length = ReadRaw<uint32_t>(12);
+    if (size_ - 16 < length)
+      {
+        Close();
+        throw Error("SnapshotReader::Open", "\"" + snapshot_path
+                    + "\" is truncated.");
+      }
+    file_path_ = std::string(data_ + 16, length);
+    global_ = 16 + length;
+    if (ReadRaw<unsigned char>(global_) != snapshot_table_)
+      {
+        Close();
+        throw Error("SnapshotReader::Open", "The global table is missing in \""
+                    + snapshot_path + "\".");
+      }
+    ClearPrefix();
+  }
+
+
+  //! Closes the snapshot.
+  void SnapshotReader::Close()
+  {
+#ifndef _WIN32
+    if (data_ != NULL)
+      munmap(const_cast<char*>(data_), size_);
+#endif
+    data_ = NULL;
+    size_ = 0;
+    buffer_.clear();
+    global_ = 0;
+    snapshot_path_ = "";
+    file_path_ = "";
+  }
+
+
+  //! Retrieves a value from the snapshot.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] default_value default value for the entry in case it is not
+    found in the snapshot.
+    \param[out] value value of the entry.
+  */
+  template<class T>
+  void SnapshotReader::Set(std::string name, const T& default_value, T& value)
+  {
+    SetValue(name, default_value, true, value);
+  }
+
+
+  //! Retrieves a value from the snapshot.
+  /*!
+    \param[in] name name of the entry.
+    \param[out] value value of the entry.
+  */
+  template<class T>
+  void SnapshotReader::Set(std::string name, T& value)
+  {
+    SetValue(name, value, false, value);
+  }
+
+
+  //! Retrieves a value from the snapshot.
+  /*!
+    \param[in] name name of the entry.
+    \return The value of the entry.
+  */
+  template<class T>
+  T SnapshotReader::Get(std::string name)
+  {
+    T value;
+    SetValue(name, value, false, value);
+    return value;
+  }
+
+
+  //! Retrieves a value from the snapshot.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] default_value default value for the entry in case it is not
+    found in the snapshot.
+    \return The value of the entry.
+  */
+  template<class T>
+  T SnapshotReader::Get(std::string name, const T& default_value)
+  {
+    T value;
+    SetValue(name, default_value, true, value);
+    return value;
+  }
+
+
+  //! Returns the list of the entries of a table.
+  /*!
+    \param[in] name the name of the table.
+    \return The keys of the table, sorted.
+  */
+  std::vector<std::string> SnapshotReader::GetEntryList(std::string name)
+  {
+    std::size_t position = Find(Name(name));
+    if (position == std::string::npos)
+      throw Error("SnapshotReader::GetEntryList",
+                  "The " + Entry(name) + " was not found.");
+    if (ReadRaw<unsigned char>(position) != snapshot_table_)
+      throw Error("SnapshotReader::GetEntryList",
+                  "The " + Entry(name) + " does not contain other entries.");
+
+    std::vector<std::string> key_list;
+    std::string key;
+    uint32_t count = ReadRaw<uint32_t>(position + 1);
+    position += 13;
+    for (uint32_t i = 0; i < count; i++)
+      {
+        if (!Convert(position, key))
+          throw Error("SnapshotReader::GetEntryList",
+                      "Unable to read the keys of " + Entry(name) + ".");
+        key_list.push_back(key);
+        position = Skip(Skip(position));
+      }
+    std::sort(key_list.begin(), key_list.end());
+    return key_list;
+  }
+
+
+  //! Checks whether an entry exists.
+  /*!
+    \param[in] name the name of the entry.
+    \return True if the entry exists, false otherwise.
+    \note The prefix is prepended to \a name.
+  */
+  bool SnapshotReader::Exists(std::string name)
+  {
+    return Find(Name(name)) != std::string::npos;
+  }
+
+
+  //! Checks whether an entry is a table.
+  /*!
+    \param[in] name the name of the entry.
+    \return True if the entry is a table, false otherwise.
+    \note The prefix is prepended to \a name.
+  */
+  bool SnapshotReader::IsTable(std::string name)
+  {
+    std::size_t position = Find(Name(name));
+    return position != std::string::npos
+      && ReadRaw<unsigned char>(position) == snapshot_table_;
+  }
+
+
+  //! Checks whether an entry is a function.
+  /*! The functions of the standard libraries are saved by name, and are not
+    recognized as functions.
+    \param[in] name the name of the entry.
+    \return True if the entry is a function, false otherwise.
+    \note The prefix is prepended to \a name.
+  */
+  bool SnapshotReader::IsFunction(std::string name)
+  {
+    std::size_t position = Find(Name(name));
+    return position != std::string::npos
+      && ReadRaw<unsigned char>(position) == snapshot_function_;
+  }
+
+
+  ////////////////////
+  // ACCESS METHODS //
+  ////////////////////
+
+
+  //! Returns the path to the snapshot.
+  /*!
+    \return The path to the snapshot.
+  */
+  std::string SnapshotReader::GetSnapshotPath() const
+  {
+    return snapshot_path_;
+  }
+
+
+  //! Returns the path to the configuration file of the snapshot.
+  /*!
+    \return The path to the configuration file from which the snapshot was
+    made.
+  */
+  std::string SnapshotReader::GetFilePath() const
+  {
+    return file_path_;
+  }
+
+
+  //! Returns the prefix prepended to the entries names.
+  /*!
+    \return The prefix.
+  */
+  std::string SnapshotReader::GetPrefix() const
+  {
+    return prefix_;
+  }
+
+
+  //! Sets the prefix prepended to the entries names.
+  /*!
+    \param[in] prefix the new prefix.
+  */
+  void SnapshotReader::SetPrefix(std::string prefix)
+  {
+    prefix_ = prefix;
+  }
+
+
+  //! Clears the prefix prepended to the entries names.
+  void SnapshotReader::ClearPrefix()
+  {
+    prefix_ = "";
+  }
+
+
+  ///////////////////////
+  // PROTECTED METHODS //
+  ///////////////////////
+
+
+  //! Retrieves a value from the snapshot.
+  /*!
+    \param[in] name name of the entry.
+    \param[in] default_value default value for the entry in case it is not
+    found in the snapshot.
+    \param[in] with_default is there a default value? If not, \a
+    default_value is ignored.
+    \param[out] value the value of the entry named \a name.
+  */
+  template<class T>
+  void SnapshotReader::SetValue(std::string name, const T& default_value,
+                                bool with_default, T& value)
+  {
+    std::size_t position = Find(Name(name));
+    if (position == std::string::npos)
+      {
+        if (!with_default)
+          throw Error("SnapshotReader::SetValue",
+                      "The " + Entry(name) + " was not found.");
+        value = default_value;
+        return;
+      }
+    if (!Convert(position, value))
+      throw Error("SnapshotReader::SetValue",
+                  "The " + Entry(name) + " has not the expected type.");
+  }
+
+
+  //! Retrieves a vector from the snapshot.
+  /*! The elements are in the order of the table in the configuration.
+    \param[in] name name of the entry.
+    \param[in] default_value default value for the entry in case it is not
+    found in the snapshot.
+    \param[in] with_default is there a default value? If not, \a
+    default_value is ignored.
+    \param[out] value the value of the entry named \a name.
+  */
+  template<class T>
+  void SnapshotReader::SetValue(std::string name,
+                                const std::vector<T>& default_value,
+                                bool with_default, std::vector<T>& value)
+  {
+    std::size_t position = Find(Name(name));
+    if (position == std::string::npos)
+      {
+        if (!with_default)
+          throw Error("SnapshotReader::SetValue",
+                      "The " + Entry(name) + " was not found.");
+        value = default_value;
+        return;
+      }
+    if (ReadRaw<unsigned char>(position) != snapshot_table_)
+      throw Error("SnapshotReader::SetValue",
+                  "The " + Entry(name) + " is not a table.");
+
+    std::vector<T> element_list;
+    T element;
+    std::string key;
+    uint32_t count = ReadRaw<uint32_t>(position + 1);
+    position += 13;
+    for (uint32_t i = 0; i < count; i++)
+      {
+        std::size_t element_position = Skip(position);
+        if (!Convert(Resolve(element_position), element))
+          {
+            Convert(position, key);
+            throw Error("SnapshotReader::SetValue",
+                        "The " + Entry(name + "[" + key + "]")
+                        + " has not the expected type.");
+          }
+        element_list.push_back(element);
+        position = Skip(element_position);
+      }
+    value = element_list;
+  }
+
+
+  //! Finds an entry.
+  /*! The names have the syntax of 'Ops::Ops': "table.subtable" or
+    "vector[2]", for instance.
+    \param[in] name the name of the entry.
+    \return The position of the value of the entry, or std::string::npos if
+    it is not found. References are resolved.
+  */
+  std::size_t SnapshotReader::Find(const std::string& name) const
+  {
+    if (data_ == NULL)
+      throw Error("SnapshotReader::Find", "No snapshot is open.");
+
+    std::size_t position = global_;
+    std::size_t start = 0;
+    while (start < name.size())
+      {
+        if (name[start] == '[')
+          // Access to an element through "[i]".
+          {
+            std::size_t end = name.find(']', start);
+            if (start == 0 || end == std::string::npos || end == start + 1)
+              return std::string::npos;
+            for (std::size_t i = start + 1; i < end; i++)
+              if (!isdigit(name[i]))
+                return std::string::npos;
+            position = FindIndex(position, std::atof(name.substr(start + 1,
+                                                                 end - start
+                                                                 - 1)
+                                                     .c_str()));
+            start = end + 1;
+            if (start < name.size() && name[start] == '.')
+              start++;
+          }
+        else
+          {
+            std::size_t end = name.find_first_of(".[", start);
+            if (end == start)
+              return std::string::npos;
+            if (end == std::string::npos)
+              end = name.size();
+            position = FindField(position, name.substr(start, end - start));
+            start = end;
+            if (start < name.size() && name[start] == '.')
+              start++;
+          }
+        if (position == std::string::npos)
+          return std::string::npos;
+      }
+    return position;
+  }
+
+
+  //! Finds the field of a table with a string key.
+  /*!
+    \param[in] table position of the table.
+    \param[in] key the key.
+    \return The position of the value (with references resolved), or
+    std::string::npos if the key is not found or if \a table is not a table.
+  */
+  std::size_t SnapshotReader::FindField(std::size_t table,
+                                        const std::string& key) const
+  {
+    if (ReadRaw<unsigned char>(table) != snapshot_table_)
+      return std::string::npos;
+    uint32_t count = ReadRaw<uint32_t>(table + 1);
+    std::size_t position = table + 13;
+    for (uint32_t i = 0; i < count; i++)
+      {
+        std::size_t value = Skip(position);
+        if (ReadRaw<unsigned char>(position) == snapshot_string_
+            && ReadRaw<uint32_t>(position + 1) == key.size()
+            && key.compare(0, key.size(), data_ + position + 5, key.size())
+            == 0)
+          return Resolve(value);
+        position = Skip(value);
+      }
+    return std::string::npos;
+  }
+
+
+  //! Finds the field of a table with a numeric key.
+  /*!
+    \param[in] table position of the table.
+    \param[in] index the key.
+    \return The position of the value (with references resolved), or
+    std::string::npos if the key is not found or if \a table is not a table.
+  */
+  std::size_t SnapshotReader::FindIndex(std::size_t table, double index) const
+  {
+    if (ReadRaw<unsigned char>(table) != snapshot_table_)
+      return std::string::npos;
+    uint32_t count = ReadRaw<uint32_t>(table + 1);
+    std::size_t position = table + 13;
+    for (uint32_t i = 0; i < count; i++)
+      {
+        std::size_t value = Skip(position);
+        if (ReadRaw<unsigned char>(position) == snapshot_number_
+            && ReadRaw<double>(position + 1) == index)
+          return Resolve(value);
+        position = Skip(value);
+      }
+    return std::string::npos;
+  }
+
+
+  //! Follows a reference to a table or a function already serialized.
+  /*!
+    \param[in] position position of a value.
+    \return The position of the value referenced, or \a position if the
+    value is not a reference.
+  */
+  std::size_t SnapshotReader::Resolve(std::size_t position) const
+  {
+    if (ReadRaw<unsigned char>(position) != snapshot_reference_)
+      return position;
+    uint64_t target = ReadRaw<uint64_t>(position + 1);
+    if (target >= size_)
+      throw Error("SnapshotReader::Resolve", "The snapshot \"" + snapshot_path_
+                  + "\" is corrupted.");
+    return static_cast<std::size_t>(target);
+  }
+
+
+  //! Skips a value.
+  /*!
+    \param[in] position position of the value.
+    \return The position that follows the value.
+  */
+  std::size_t SnapshotReader::Skip(std::size_t position) const
+  {
+    uint64_t length;
+    switch (ReadRaw<unsigned char>(position))
+      {
+      case snapshot_nil_:
+      case snapshot_false_:
+      case snapshot_true_:
+        return position + 1;
+      case snapshot_number_:
+      case snapshot_reference_:
+        return position + 9;
+      case snapshot_string_:
+      case snapshot_library_:
+        length = 5 + uint64_t(ReadRaw<uint32_t>(position + 1));
+        break;
+      case snapshot_table_:
+      case snapshot_function_:
+        length = 13 + ReadRaw<uint64_t>(position + 5);
+        break;
+      default:
+        throw Error("SnapshotReader::Skip", "The snapshot \"" + snapshot_path_
+                    + "\" is corrupted.");
+      }
+    if (length > size_ - position)
+      throw Error("SnapshotReader::Skip", "The snapshot \"" + snapshot_path_
+                  + "\" is truncated.");
+    return position + static_cast<std::size_t>(length);
+  }
+
+
+  //! Reads the binary representation of a value.
+  /*!
+    \param[in] position position of the value.
+    \return The value.
+  */
+  template<class T>
+  T SnapshotReader::ReadRaw(std::size_t position) const
+  {
+    if (position > size_ || size_ - position < sizeof(T))
+      throw Error("SnapshotReader::ReadRaw", "The snapshot \"" + snapshot_path_
+                  + "\" is truncated.");
+    T value;
+    std::memcpy(&value, data_ + position, sizeof(T));
+    return value;
+  }
+
+
+  //! Reads a string (without its tag).
+  /*!
+    \param[in] position position of the length of the string.
+    \return The string.
+  */
+  std::string SnapshotReader::ReadString(std::size_t position) const
+  {
+    uint32_t length = ReadRaw<uint32_t>(position);
+    if (size_ - position - 4 < length)
+      throw Error("SnapshotReader::ReadString", "The snapshot \""
+                  + snapshot_path_ + "\" is truncated.");
+    return std::string(data_ + position + 4, length);
+  }
+
+
+  //! Converts a value to a Boolean.
+  /*!
+    \param[in] position position of the value.
+    \param[out] output converted value.
+    \return True if the conversion was successful, false otherwise.
+  */
+  bool SnapshotReader::Convert(std::size_t position, bool& output) const
+  {
+    unsigned char tag = ReadRaw<unsigned char>(position);
+    if (tag != snapshot_false_ && tag != snapshot_true_)
+      return false;
+    output = tag == snapshot_true_;
+    return true;
+  }
+
+
+  //! Converts a value to an integer.
+  /*! As in Lua, a string is converted if it represents a number.
+    \param[in] position position of the value.
+    \param[out] output converted value.
+    \return True if the conversion was successful, false otherwise.
+  */
+  bool SnapshotReader::Convert(std::size_t position, int& output) const
+  {
+    double number;
+    if (!Convert(position, number))
+      return false;
+    int value = static_cast<int>(number);
+    if (static_cast<double>(value) != number)
+      return false;
+    output = value;
+    return true;
+  }
+
+
+  //! Converts a value to a float.
+  /*! As in Lua, a string is converted if it represents a number.
+    \param[in] position position of the value.
+    \param[out] output converted value.
+    \return True if the conversion was successful, false otherwise.
+  */
+  bool SnapshotReader::Convert(std::size_t position, float& output) const
+  {
+    double number;
+    if (!Convert(position, number))
+      return false;
+    output = static_cast<float>(number);
+    return true;
+  }
+
+
+  //! Converts a value to a double.
+  /*! As in Lua, a string is converted if it represents a number.
+    \param[in] position position of the value.
+    \param[out] output converted value.
+    \return True if the conversion was successful, false otherwise.
+  */
+  bool SnapshotReader::Convert(std::size_t position, double& output) const
+  {
+    unsigned char tag = ReadRaw<unsigned char>(position);
+    if (tag == snapshot_number_)
+      {
+        output = ReadRaw<double>(position + 1);
+        return true;
+      }
+    if (tag != snapshot_string_)
+      return false;
+    std::string value = ReadString(position + 1);
+    const char* begin = value.c_str();
+    char* end;
+    output = std::strtod(begin, &end);
+    if (end == begin)
+      return false;
+    while (isspace(static_cast<unsigned char>(*end)))
+      end++;
+    return *end == '\0';
+  }
+
+
+  //! Converts a value to a string.
+  /*! As in Lua, a number is converted to a string.
+    \param[in] position position of the value.
+    \param[out] output converted value.
+    \return True if the conversion was successful, false otherwise.
+  */
+  bool SnapshotReader::Convert(std::size_t position, std::string& output)
+    const
+  {
+    unsigned char tag = ReadRaw<unsigned char>(position);
+    if (tag == snapshot_string_)
+      {
+        output = ReadString(position + 1);
+        return true;
+      }
+    if (tag != snapshot_number_)
+      return false;
+    // The default format of Lua for numbers.
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.14g",
+                  ReadRaw<double>(position + 1));
+    output = number;
+    return true;
+  }
+
+
+  //! Prepends the prefix to an entry name.
+  /*!
+    \param[in] name name of the entry.
+    \return The entry name with the prefix prepended.
+  */
+  std::string SnapshotReader::Name(const std::string& name) const
+  {
+    return prefix_ + name;
+  }
+
+
+  //! Formats the description of an entry.
+  /*!
+    \param[in] name name of the entry.
+    \return A std::string with the entry name and the path to the snapshot,
+    both quoted.
+  */
+  std::string SnapshotReader::Entry(const std::string& name) const
+  {
+    return "entry \"" + Name(name) + "\" in \"" + snapshot_path_ + "\"";
+  }
+
+
+  ////////////////////////////
+  // EXPLICIT INSTANTIATION //
+  ////////////////////////////
+
+
+#define OPS_SNAPSHOT_READER_INSTANTIATE(T)                              \
+  template void SnapshotReader::Set(std::string, const T&, T&);         \
+  template void SnapshotReader::Set(std::string, T&);                   \
+  template T SnapshotReader::Get(std::string);                          \
+  template T SnapshotReader::Get(std::string, const T&);
+
+  OPS_SNAPSHOT_READER_INSTANTIATE(bool)
+  OPS_SNAPSHOT_READER_INSTANTIATE(int)
+  OPS_SNAPSHOT_READER_INSTANTIATE(float)
+  OPS_SNAPSHOT_READER_INSTANTIATE(double)
+  OPS_SNAPSHOT_READER_INSTANTIATE(std::string)
+  OPS_SNAPSHOT_READER_INSTANTIATE(std::vector<bool>)
+  OPS_SNAPSHOT_READER_INSTANTIATE(std::vector<int>)
+  OPS_SNAPSHOT_READER_INSTANTIATE(std::vector<float>)
+  OPS_SNAPSHOT_READER_INSTANTIATE(std::vector<double>)
+  OPS_SNAPSHOT_READER_INSTANTIATE(std::vector<std::string>)
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_SNAPSHOTREADER_CXX
+#endif
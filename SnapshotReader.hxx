@@ -0,0 +1,144 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+
+#ifndef OPS_FILE_SNAPSHOTREADER_HXX
+
+// This header, and the library "ops_snapshot_reader", do not depend on Lua.
+// The types supported by 'Get' and 'Set' are bool, int, float, double,
+// std::string and the vectors of these types.
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Error.hxx"
+
+
+namespace Ops
+{
+
+
+  //! Read-only access to a snapshot, without Lua.
+  /*! A snapshot is a file written by 'Ops::WriteSnapshot'. It is mapped in
+    memory, and the entries are read in place, with the same names as in
+    'Ops::Ops' (e.g., "table.subtable.vector[2]"). The functions of the
+    configuration cannot be called, and the metatables are not saved in the
+    snapshots.
+  */
+  class SnapshotReader
+  {
+  protected:
+    //! Path to the snapshot.
+    std::string snapshot_path_;
+    //! Path to the configuration file from which the snapshot was made.
+    std::string file_path_;
+    //! Content of the snapshot.
+    const char* data_;
+    //! Size of the snapshot in bytes.
+    std::size_t size_;
+    //! Content of the snapshot, if it is not mapped in memory.
+    std::string buffer_;
+    //! Position of the global table in the snapshot.
+    std::size_t global_;
+    //! Prefix to be prepended to the entries names.
+    std::string prefix_;
+
+    //! Latest version of the format of 'Ops::Serialize'.
+    static const uint32_t snapshot_version_ = 2;
+    //! Tags of the values, as written by 'Ops::Serialize'.
+    enum
+      {
+        snapshot_false_ = 1,
+        snapshot_true_ = 2,
+        snapshot_number_ = 3,
+        snapshot_string_ = 4,
+        snapshot_table_ = 5,
+        snapshot_reference_ = 6,
+        snapshot_function_ = 7,
+        snapshot_library_ = 8,
+        snapshot_nil_ = 9
+      };
+
+  public:
+    // Constructors and destructor.
+    SnapshotReader();
+    explicit SnapshotReader(std::string snapshot_path);
+    ~SnapshotReader();
+
+    // Main methods.
+    void Open(std::string snapshot_path);
+    void Close();
+    template<class T>
+    void Set(std::string name, const T& default_value, T& value);
+    template<class T>
+    void Set(std::string name, T& value);
+    template<class T>
+    T Get(std::string name);
+    template<class T>
+    T Get(std::string name, const T& default_value);
+    std::vector<std::string> GetEntryList(std::string name = "");
+    bool Exists(std::string name);
+    bool IsTable(std::string name);
+    bool IsFunction(std::string name);
+
+    // Access methods.
+    std::string GetSnapshotPath() const;
+    std::string GetFilePath() const;
+    std::string GetPrefix() const;
+    void SetPrefix(std::string prefix);
+    void ClearPrefix();
+
+  protected:
+    template<class T>
+    void SetValue(std::string name, const T& default_value,
+                  bool with_default, T& value);
+    template<class T>
+    void SetValue(std::string name, const std::vector<T>& default_value,
+                  bool with_default, std::vector<T>& value);
+
+    std::size_t Find(const std::string& name) const;
+    std::size_t FindField(std::size_t table, const std::string& key) const;
+    std::size_t FindIndex(std::size_t table, double index) const;
+    std::size_t Resolve(std::size_t position) const;
+    std::size_t Skip(std::size_t position) const;
+    template<class T>
+    T ReadRaw(std::size_t position) const;
+    std::string ReadString(std::size_t position) const;
+
+    bool Convert(std::size_t position, bool& output) const;
+    bool Convert(std::size_t position, int& output) const;
+    bool Convert(std::size_t position, float& output) const;
+    bool Convert(std::size_t position, double& output) const;
+    bool Convert(std::size_t position, std::string& output) const;
+
+    std::string Name(const std::string& name) const;
+    std::string Entry(const std::string& name) const;
+
+  private:
+    SnapshotReader(const SnapshotReader&);
+    SnapshotReader& operator=(const SnapshotReader&);
+  };
+
+
+} // namespace Ops.
+
+
+#define OPS_FILE_SNAPSHOTREADER_HXX
+#endif
@@ -0,0 +1,129 @@
+### This file benchmarks the Python interface of Ops: import of the module,
+### 'Open', scalar and vector reads, traversal with 'GetEntryList' and calls
+### to Lua functions. The typed methods generated by SWIG ('GetDouble',
+### 'ApplyDouble', ...) are compared with the dynamically typed methods
+### ('GetValue', 'ApplyValue').
+
+# Usage: python benchmark.py [--count N] [--json FILE]
+
+# The configuration files are generated in a temporary directory, so that the
+# benchmark runs offline. With "--json", the results are written in the JSON
+# format of Google Benchmark (like the C++ benchmarks), in nanoseconds per
+# call, so that the cost of the bindings can be tracked separately from the
+# cost of the library.
+
+# The module built with "scons lean=yes" has no typed methods: only the
+# dynamically typed methods are then measured, and the import time can be
+# compared with the one of the full module.
+
+from __future__ import print_function
+import argparse, json, os, platform, shutil, sys, tempfile, time
+
+start = time.time()
+import ops
+import_time = time.time() - start
+
+
+parser = argparse.ArgumentParser(description = "Benchmarks the Python "
+                                 "interface of Ops.")
+parser.add_argument("--count", type = int, default = 20000,
+                    help = "number of calls per measurement")
+parser.add_argument("--json", help = "file in which the results are written")
+args = parser.parse_args()
+
+
+def measure(count, function, *arguments):
+    """Returns the mean time, in seconds, of a call to
+    'function(*arguments)'."""
+    start = time.time()
+    for i in range(count):
+        function(*arguments)
+    return (time.time() - start) / count
+
+
+def write_configuration(directory):
+    """Writes a configuration with nested tables, vectors and functions, and
+    returns its path."""
+    path = os.path.join(directory, "benchmark.lua")
+    f = open(path, "w")
+    f.write("scalar = 1.5\ninteger = 12\nname = \"benchmark\"\n")
+    f.write("vector = {" + ", ".join(str(0.5 * i) for i in range(1000))
+            + "}\n")
+    f.write("section = {}\n")
+    for i in range(100):
+        f.write("section.s%d = {a = %d, b = %d.5, c = \"c%d\", "
+                "d = {1, 2, 3}}\n" % (i, i, i, i))
+    f.write("function f(x, y, z)\n   return x * y + z\nend\n")
+    f.close()
+    return path
+
+
+def traverse(config, name):
+    """Reads recursively all entry names under 'name'."""
+    count = 0
+    for entry in config.GetEntryList(name):
+        count += 1
+        if config.IsTable(name + "." + entry):
+            count += traverse(config, name + "." + entry)
+    return count
+
+
+directory = tempfile.mkdtemp()
+try:
+    path = write_configuration(directory)
+    config = ops.Ops(path)
+    count = args.count
+    typed = hasattr(config, "GetDouble")
+
+    result = [("import", 1, import_time)]
+    result.append(("Open", count // 100,
+                   measure(count // 100, config.Open, path)))
+    if typed:
+        result.append(("GetDouble", count,
+                       measure(count, config.GetDouble, "scalar")))
+        result.append(("GetInt", count,
+                       measure(count, config.GetInt, "integer")))
+        result.append(("GetString", count,
+                       measure(count, config.GetString, "name")))
+    result.append(("GetValue/double", count,
+                   measure(count, config.GetValue, "scalar")))
+    result.append(("GetValue/string", count,
+                   measure(count, config.GetValue, "name")))
+    result.append(("GetVectDouble/1000", count // 100,
+                   measure(count // 100, config.GetVectDouble, "vector")))
+    result.append(("GetValue/vector/1000", count // 100,
+                   measure(count // 100, config.GetValue, "vector")))
+    result.append(("GetEntryList/traversal", count // 1000,
+                   measure(count // 1000, traverse, config, "section")))
+    result.append(("ToDict", count // 100,
+                   measure(count // 100, config.ToDict, "section")))
+    if typed:
+        result.append(("ApplyDouble", count,
+                       measure(count, config.ApplyDouble, "f", 1., 2., 3.)))
+    result.append(("ApplyValue", count,
+                   measure(count, config.ApplyValue, "f", 1., 2., 3.)))
+    x = [float(i) for i in range(1000)]
+    result.append(("ApplyArray/1000", count // 100,
+                   measure(count // 100, config.ApplyArray, "f", x, x, 1.)))
+finally:
+    shutil.rmtree(directory)
+
+for name, iterations, duration in result:
+    print("%-25s %12.3f us" % (name, 1.e6 * duration))
+
+if args.json:
+    output = {"context": {"date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+                          "executable": sys.executable,
+                          "python_version": platform.python_version(),
+                          "library_build_type": "python"},
+              "benchmarks": [{"name": "python/" + name,
+                              "run_name": "python/" + name,
+                              "run_type": "iteration",
+                              "iterations": iterations,
+                              "real_time": 1.e9 * duration,
+                              "cpu_time": 1.e9 * duration,
+                              "time_unit": "ns"}
+                             for name, iterations, duration in result]}
+    f = open(args.json, "w")
+    json.dump(output, f, indent = 2)
+    f.close()
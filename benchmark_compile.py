@@ -0,0 +1,116 @@
+### This file benchmarks the compilation time of the clients of Ops. A project
+### with many translation units that read parameters is generated, and it is
+### compiled with the templates of Ops instantiated in every translation unit
+### ("-DOPS_NO_EXTERN_TEMPLATE"), with the templates instantiated once in the
+### library (the default, thanks to the 'extern template' declarations of
+### "OpsInstantiation.hxx"), and with the lightweight header "OpsLight.hxx".
+
+# Usage: python benchmark_compile.py [--count N] [--cxx COMPILER]
+#                                    [--include DIRECTORY] [--json FILE]
+
+# Only the compilation of the translation units is measured, not the link.
+# The total size of the object files is reported as well, since every
+# instantiation in a client ends up in its object file. With "--json", the
+# results are written in the JSON format of Google Benchmark, in nanoseconds
+# per translation unit.
+
+from __future__ import print_function
+import argparse, json, os, shutil, subprocess, tempfile, time
+
+
+parser = argparse.ArgumentParser(description = "Benchmarks the compilation "
+                                 "time of the clients of Ops.")
+parser.add_argument("--count", type = int, default = 50,
+                    help = "number of translation units")
+parser.add_argument("--cxx", default = os.environ.get("CXX", "c++"),
+                    help = "C++ compiler")
+parser.add_argument("--include", action = "append", default = [],
+                    help = "additional include directory (e.g., for Lua)")
+parser.add_argument("--json", help = "file in which the results are written")
+args = parser.parse_args()
+
+source_directory = os.path.dirname(os.path.abspath(__file__))
+
+
+# Body of a translation unit that reads parameters of several types. 'Ops' is
+# 'Ops::Ops' or 'Ops::OpsLight'.
+client = """
+double client_%(index)d(Ops::%(class)s& ops)
+{
+  int i;
+  std::vector<double> v;
+  std::vector<std::string> s;
+  ops.Set("section.integer", "v > 0", i);
+  ops.Set("section.vector", "", std::vector<double>(), v);
+  ops.Set("section.names", s);
+  bool b = ops.Get<bool>("section.flag", "", false);
+  std::string name = ops.Get<std::string>("section.name");
+  float f = ops.Get<float>("section.float");
+  return ops.Get<double>("section.double", "v >= 0") + i + v.size()
+    + s.size() + b + name.size() + f + ops.Apply("section.f", 1., 2.);
+}
+"""
+
+
+def write_project(directory, header, class_name):
+    """Writes the translation units and returns their paths."""
+    path_list = []
+    for index in range(args.count):
+        path = os.path.join(directory, "client_%d.cpp" % index)
+        f = open(path, "w")
+        f.write("#include \"%s\"\n" % header)
+        f.write(client % {"index": index, "class": class_name})
+        f.close()
+        path_list.append(path)
+    return path_list
+
+
+def compile_project(path_list, flags):
+    """Compiles the translation units and returns the time per translation
+    unit, in seconds, and the total size of the object files, in bytes."""
+    size = 0
+    start = time.time()
+    for path in path_list:
+        output = path[:-4] + ".o"
+        command = [args.cxx, "-std=c++17", "-O2", "-c", path, "-o", output,
+                   "-I" + source_directory] \
+                   + ["-I" + x for x in args.include] + flags
+        if subprocess.call(command) != 0:
+            raise Exception("Failed to compile \"" + path + "\".")
+        size += os.path.getsize(output)
+    return (time.time() - start) / len(path_list), size
+
+
+directory = tempfile.mkdtemp()
+try:
+    path_list = write_project(directory, "Ops.hxx", "Ops")
+    result = [("implicit_instantiation",)
+              + compile_project(path_list, ["-DOPS_NO_EXTERN_TEMPLATE"])]
+    result.append(("extern_template",)
+                  + compile_project(path_list, []))
+    path_list = write_project(directory, "OpsLight.hxx", "OpsLight")
+    result.append(("OpsLight",) + compile_project(path_list, []))
+finally:
+    shutil.rmtree(directory)
+
+for name, duration, size in result:
+    print("%-25s %10.1f ms per file %10d bytes of objects"
+          % (name, 1.e3 * duration, size))
+
+if args.json:
+    output = {"context": {"date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+                          "executable": args.cxx,
+                          "num_translation_units": args.count,
+                          "library_build_type": "compile"},
+              "benchmarks": [{"name": "compile/" + name,
+                              "run_name": "compile/" + name,
+                              "run_type": "iteration",
+                              "iterations": args.count,
+                              "real_time": 1.e9 * duration,
+                              "cpu_time": 1.e9 * duration,
+                              "time_unit": "ns",
+                              "object_bytes": size}
+                             for name, duration, size in result]}
+    f = open(args.json, "w")
+    json.dump(output, f, indent = 2)
+    f.close()
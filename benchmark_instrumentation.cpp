@@ -0,0 +1,136 @@
+// This file benchmarks the main operations of Ops (reads, constraints, calls
+// to Lua functions, serialization). It is compiled twice by CMake: with the
+// default null instrumentation ("opsbenchmark"), and with
+// OPS_WITH_INSTRUMENTATION and the counting hooks below
+// ("opsbenchmark_instrumented"), so that the cost of the instrumentation can
+// be measured. Since OPS_INSTRUMENT expands to nothing by default,
+// "opsbenchmark" runs exactly the code of an uninstrumented build.
+
+// Usage: opsbenchmark [count] [JSON file]
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Ops.hxx"
+
+
+#ifdef OPS_WITH_INSTRUMENTATION
+
+// A minimal profiler: it counts the operations.
+static long instrumentation_count[Ops::instrument_deserialize + 1];
+
+namespace Ops
+{
+  void InstrumentationBegin(InstrumentedOperation operation,
+                            const std::string& /* name */)
+  {
+    instrumentation_count[operation]++;
+  }
+
+  void InstrumentationEnd(InstrumentedOperation /* operation */,
+                          const std::string& /* name */)
+  {
+  }
+}
+
+#endif
+
+
+// Returns the mean time, in nanoseconds, of 'count' calls to 'function'.
+template<class F>
+double measure(int count, F function)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int i = 0; i < count; i++)
+    function();
+  chrono::duration<double, nano> duration = chrono::steady_clock::now()
+    - start;
+  return duration.count() / count;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+
+  Ops::Ops ops;
+  ops.DoString("scalar = 1.5\nsection = {integer = 12, name = \"name\"}\n"
+               "vector = {}\nfor i = 1, 100 do vector[i] = i / 2 end\n"
+               "function f(x, y, z) return x * y + z end");
+
+  vector<pair<string, double> > result;
+  volatile double sink = 0.;
+  vector<double> v;
+  result.push_back(make_pair("Get<double>", measure(count, [&]()
+    {
+      sink = sink + ops.Get<double>("scalar");
+    })));
+  result.push_back(make_pair("Get<int>/nested", measure(count, [&]()
+    {
+      sink = sink + ops.Get<int>("section.integer");
+    })));
+  result.push_back(make_pair("Get<string>/nested", measure(count, [&]()
+    {
+      sink = sink + ops.Get<string>("section.name").size();
+    })));
+  result.push_back(make_pair("Get<vector<double>>/100",
+                             measure(count / 100, [&]()
+    {
+      ops.Set("vector", v);
+      sink = sink + v[0];
+    })));
+  result.push_back(make_pair("Get<double>/constraint", measure(count, [&]()
+    {
+      sink = sink + ops.Get<double>("scalar", "v > 0");
+    })));
+  result.push_back(make_pair("Apply<double>", measure(count, [&]()
+    {
+      sink = sink + ops.Apply("f", 1., 2., 3.);
+    })));
+  result.push_back(make_pair("Serialize", measure(count / 100, [&]()
+    {
+      sink = sink + ops.Serialize().size();
+    })));
+
+#ifdef OPS_WITH_INSTRUMENTATION
+  const string prefix = "instrumented/";
+#else
+  const string prefix = "null/";
+#endif
+
+  for (size_t i = 0; i < result.size(); i++)
+    cout << left << setw(40) << prefix + result[i].first << right << setw(12)
+         << result[i].second << " ns" << endl;
+
+#ifdef OPS_WITH_INSTRUMENTATION
+  const char* operation_name[] = {"open", "resolve", "convert", "constraint",
+                                  "apply", "serialize", "deserialize"};
+  cout << "Instrumented operations:";
+  for (int i = 0; i <= Ops::instrument_deserialize; i++)
+    cout << " " << operation_name[i] << "=" << instrumentation_count[i];
+  cout << endl;
+#endif
+
+  // Results in the JSON format of Google Benchmark.
+  if (argc > 2)
+    {
+      ofstream f(argv[2]);
+      f << "{\n  \"context\": {\"library_build_type\": \"" << prefix
+        << "\"},\n  \"benchmarks\": [\n";
+      for (size_t i = 0; i < result.size(); i++)
+        f << "    {\"name\": \"" << prefix + result[i].first
+          << "\", \"run_type\": \"iteration\", \"real_time\": "
+          << result[i].second << ", \"cpu_time\": " << result[i].second
+          << ", \"time_unit\": \"ns\"}"
+          << (i + 1 < result.size() ? ",\n" : "\n");
+      f << "  ]\n}\n";
+    }
+
+  return 0;
+}
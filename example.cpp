@@ -3,6 +3,8 @@ using namespace std;
 
 #define OPS_WITH_ABORT
 #include "Ops.hxx"
+#include "ApplyPool.hxx"
+#include "SnapshotReader.hxx"
 
 
 int main(int argc, char *argv[])
@@ -59,6 +61,25 @@ int main(int argc, char *argv[])
   ops.Set("compositions.concerti_grossi_op_6",
           "(v % 2 == 0 or v % 2 == 1) and v < 13", int_vector);
 
+  // The constraints may be checked later, in bulk, at a point chosen by the
+  // application: 'Validate' raises an exception if any constraint recorded
+  // since is not satisfied. 'ValidateAsync' checks them in another thread,
+  // and its future holds the list of the failures.
+  ops.SetDeferredValidation();
+  ops.Set("birth_year", "v > 1600", integer);
+  ops.Validate();
+  ops.SetDeferredValidation(false);
+
+  // The constraints may also be C++ predicates, which are not compiled by
+  // Lua. 'Range', 'OneOf' and 'Satisfies' build predicates with a
+  // description (for the error messages), and they may be combined with
+  // '&&', '||' and '!'. A lambda returning a Boolean is accepted as well.
+  integer = ops.Get<int>("birth_year", Ops::Range(1600, 1800));
+  str = ops.Get<string>("one_composition",
+                        Ops::OneOf("Messiah", "Water Music"));
+  ops.Set("compositions.concerti_grossi_op_6",
+          [](int v) { return v > 0 && v < 13; }, int_vector);
+
   /*** Default values ***/
 
   // It is possible to set a variable to a default value if it is not
@@ -81,11 +102,149 @@ int main(int argc, char *argv[])
   cout << "Call to function \"sum_product\": " << out[0]
        << ", " << out[1] << endl;
 
+  /*** Dynamic typing ***/
+
+  // If the type of an entry is not known in advance, an 'Ops::Value' (a
+  // std::variant of the supported types) may be retrieved.
+  Ops::Value value = ops.Get<Ops::Value>("nationality");
+  if (holds_alternative<vector<string> >(value))
+    cout << "\"nationality\" is a list of "
+         << get<vector<string> >(value).size() << " strings." << endl;
+
+  /*** Inheritance ***/
+
+  // A table may inherit the entries of another table through the '__index'
+  // field of its metatable (see "aria" in "example.lua"). The inherited
+  // entries are listed and read like the other entries.
+  vector<string> voices;
+  ops.Set("aria.voices", voices);
+  cout << "Entries of \"aria\":";
+  vector<string> entry_list = ops.GetEntryList("aria");
+  for (size_t i = 0; i < entry_list.size(); i++)
+    cout << " " << entry_list[i];
+  cout << " (" << ops.Get<string>("aria.tempo") << ", " << voices.size()
+       << " voices)" << endl;
+  // For configurations without metatables, the metamethods may be skipped.
+  ops.SetRawAccess();
+  if (!ops.Exists("aria.tempo"))
+    cout << "In raw mode, \"aria.tempo\" is not found." << endl;
+  ops.SetRawAccess(false);
+
+  /*** Lazy tables ***/
+
+  // A large table may be placed in a separate file, which is only run on the
+  // first access to the table. 'ops.lazy' is provided by the module 'ops'.
+  ops.DoString("local ops = require 'ops'\n"
+               "ops.lazy('oratorios', 'example_lazy.lua')\n"
+               "ops.lazy('oratorio_parts', 'example_lazy.lua')");
+  cout << "Year of \"Messiah\": " << ops.Get<int>("oratorios.messiah.year")
+       << endl;
+  // The lazy tables are loaded in raw mode as well.
+  ops.SetRawAccess();
+  cout << "Parts of \"Solomon\": "
+       << ops.Get<int>("oratorio_parts.solomon.parts") << endl;
+  ops.SetRawAccess(false);
+
+  /*** Thunks ***/
+
+  // An entry may be computed on its first read only, with 'ops.thunk'. In
+  // Lua, 'ops.force' returns the value of a thunk.
+  ops.DoString("local ops = require 'ops'\n"
+               "catalogue = {operas = ops.thunk(function()\n"
+               "                       return #compositions.operas end)}\n"
+               "catalogue.works = ops.thunk(function()\n"
+               "  return ops.force(catalogue.operas)\n"
+               "    + #compositions.oratorios end)");
+  cout << "Number of operas: " << ops.Get<int>("catalogue.operas") << endl;
+
+  /*** Overrides ***/
+
+  // An entry may be overridden from C++, without calling the Lua compiler.
+  // With 'OpenJournal', the overrides are also appended to a journal, which
+  // 'ReplayJournal' applies after a restart.
+  ops.Override("aria.tempo", string("Larghetto"));
+  cout << "New tempo: " << ops.Get<string>("aria.tempo") << endl;
+
+  /*** Snapshots ***/
+
+  // The evaluated configuration, functions included, may be saved in a file
+  // that is loaded without running the configuration file again.
+  ops.WriteSnapshot("example.snapshot");
+  Ops::Ops snapshot;
+  snapshot.ReadSnapshot("example.snapshot");
+  cout << "Call to function \"sum\" after reloading: "
+       << snapshot.Apply("sum", 1, 2, 3) << endl;
+  // The inherited entries are saved with the entries of the table.
+  cout << "Voices of \"aria\" after reloading: "
+       << snapshot.Get<vector<string> >("aria.voices").size() << endl;
+  // The thunks are evaluated when the snapshot is written.
+  cout << "Number of works after reloading: "
+       << snapshot.Get<int>("catalogue.works") << endl;
+  // Tools that only read the configuration may use 'Ops::SnapshotReader',
+  // which does not depend on Lua and maps the snapshot in memory.
+  Ops::SnapshotReader reader("example.snapshot");
+  cout << "Birth year in the snapshot: " << reader.Get<int>("birth_year")
+       << endl;
+  remove("example.snapshot");
+
+  // With many processes (e.g., MPI ranks), the configuration file may be run
+  // by one process only, which sends the evaluated configuration to the
+  // other processes with a transport provided by the application.
+  string message;
+  Ops::Ops root, rank;
+  root.OpenBroadcast("example.lua", true, [&message](string& buffer)
+                     {
+                       message = buffer;
+                     });
+  rank.OpenBroadcast("example.lua", false, [&message](string& buffer)
+                     {
+                       buffer = message;
+                     });
+  cout << "Last name received: " << rank.Get<string>("last_name") << endl;
+  // The other processes see the inherited entries as the root does.
+  cout << "Tempo of \"aria\" received: " << rank.Get<string>("aria.tempo")
+       << endl;
+
+  /*** Pool of Lua states ***/
+
+  // Functions may be called in worker threads, each with its own Lua state
+  // loaded from a snapshot of the configuration. With C++20 coroutines,
+  // 'co_await ops.ApplyAsync("sum", 1., 2., 3.)' suspends the coroutine
+  // until the call completes in the pool (see "example_async.cpp").
+  ops.StartApplyPool(2);
+  double pool_sum;
+  future<void> pool_call
+    = ops.GetApplyPool().Submit([&pool_sum](Ops::Ops& state)
+                                {
+                                  pool_sum = state.Apply("sum", 1., 2., 3.);
+                                });
+  pool_call.get();
+  cout << "Call to function \"sum\" in the pool: " << pool_sum << endl;
+  ops.StopApplyPool();
+
   /*** Saving the configuration ***/
 
   // All variables, except functions, that were read can be written in a Lua
-  // file.
-  ops.WriteLuaDefinition("what_was_read.lua");
+  // file, with 'WriteLuaDefinition', or in the background with
+  // 'WriteLuaDefinitionAsync'.
+  future<string> written = ops.WriteLuaDefinitionAsync("what_was_read.lua");
+
+  /*** Startup report ***/
+
+  // The wall time and the memory of each phase of 'Open' (creation of the
+  // Lua state, parsing and execution of the file and of the files it runs
+  // with 'dofile', garbage collection) can be recorded.
+  Ops::Ops report;
+  report.EnableOpenReport();
+  report.Open("example.lua");
+  cout << report.OpenReport().Str();
+  // 'OpenReport().Json()' exports the same report in JSON.
+
+  // Waits for "what_was_read.lua". The future holds the error message, if
+  // any.
+  string error = written.get();
+  if (!error.empty())
+    cout << error << endl;
 
   return 0;
 }
@@ -24,6 +24,11 @@ one_composition = compositions.suites[1] -- warning: indexes start at 1.
 -- Concatenation of strings:
 full_name = name.first_name.." "..name.last_name
 
+-- A table may inherit the entries of another table, through the '__index'
+-- field of its metatable:
+default = {tempo = "Largo", voices = {"soprano", "alto"}}
+aria = setmetatable({name = "Ombra mai fu"}, {__index = default})
+
 -- Functions may be defined:
 function sum(i, j, k)
    return i + j + k
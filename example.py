@@ -60,6 +60,27 @@ print "Call to function \"sum\":", ops.ApplyInt("sum", 1, 2, 3)
 print "Call to function \"sum_product\":", \
     ops.ApplyDoubleDouble("sum_product", [1., 2.5, 3.])
 
+# A function can be applied elementwise to arrays (NumPy arrays, lists or
+# numbers). The loop is performed in C++.
+print "Elementwise sum:", ops.ApplyArray("sum", [1., 2.], [3., 4.], 10.)
+
+### Bulk export
+
+# All entries (except functions) can be exported at once into nested
+# dictionaries. Lists of numbers are returned as NumPy arrays when NumPy is
+# available.
+print "Compositions:", ops.ToDict("compositions")
+
+### Serialization
+
+# An 'Ops' object can be pickled, e.g. to be sent to 'multiprocessing'
+# workers. The configuration is not evaluated again when unpickled, and the
+# functions are preserved. The prefix is cleared.
+import pickle
+copy = pickle.loads(pickle.dumps(ops))
+print "Full name (copy):", copy.GetString("full_name")
+print "Call to function \"sum\" (copy):", copy.ApplyInt("sum", 1, 2, 3)
+
 ### Saving the configuration
 
 ops.WriteLuaDefinition("what_was_read.lua")
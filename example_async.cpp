@@ -0,0 +1,64 @@
+#include <iostream>
+#include <future>
+using namespace std;
+
+// 'ApplyAsync' requires C++20 coroutines: this example is compiled with
+// C++20.
+#define OPS_WITH_ABORT
+#include "Ops.hxx"
+
+
+// A coroutine that starts at once and runs until its first suspension.
+struct Task
+{
+  struct promise_type
+  {
+    Task get_return_object()
+    {
+      return Task();
+    }
+    suspend_never initial_suspend()
+    {
+      return suspend_never();
+    }
+    suspend_never final_suspend() noexcept
+    {
+      return suspend_never();
+    }
+    void return_void()
+    {
+    }
+    void unhandled_exception()
+    {
+      terminate();
+    }
+  };
+};
+
+
+// The coroutine is suspended while "sum" runs in the pool, and resumed in a
+// worker thread.
+Task Sum(Ops::Ops& ops, promise<double>& result)
+{
+  double sum = co_await ops.ApplyAsync("sum", 1., 2., 3.);
+  result.set_value(sum);
+}
+
+
+int main()
+{
+  Ops::Ops ops("example.lua");
+
+  // Every worker of the pool has its own Lua state, loaded from a snapshot
+  // of the configuration.
+  ops.StartApplyPool(2);
+
+  promise<double> result;
+  future<double> sum = result.get_future();
+  Sum(ops, result);
+  cout << "Call to function \"sum\" in a coroutine: " << sum.get() << endl;
+
+  ops.StopApplyPool();
+
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ops_c.h"
+
+
+/* Prints the last error and leaves. */
+#define CHECK(call)                                                     \
+  if ((status = (call)) != OPS_OK)                                      \
+    {                                                                   \
+      fprintf(stderr, "Error %d: %s\n", status, ops_error_message(ops)); \
+      ops_destroy(ops);                                                 \
+      return 1;                                                         \
+    }
+
+
+int main(void)
+{
+  int status, integer, exists;
+  char str[64];
+  size_t length, size, i;
+  int int_array[16];
+  double in[3] = {1., 2.5, 3.}, out[2];
+  ops_handle_t* ops;
+  ops_function_t* sum_product;
+
+  if (ops_create(&ops) != OPS_OK)
+    return 1;
+  CHECK(ops_open(ops, "example.lua", strlen("example.lua")));
+
+  /*** Basic access ***/
+
+  /* The names are given with their lengths, so that they need not be
+     null-terminated. */
+  CHECK(ops_get_string(ops, "last_name", 9, str, sizeof(str), &length));
+  printf("Last name: %s\n", str);
+
+  CHECK(ops_get_int(ops, "birth_year", 10, &integer));
+  printf("Birth year: %d\n", integer);
+
+  /* The arrays are copied into a buffer provided by the caller. If the
+     buffer is too small, OPS_ERROR_BUFFER is returned together with the
+     required size. */
+  status = ops_get_int_array(ops, "compositions.concerti_grossi_op_6", 33,
+                             int_array, 4, &size);
+  printf("Buffer of 4 elements: status %d, %d elements needed\n", status,
+         (int) size);
+  CHECK(ops_get_int_array(ops, "compositions.concerti_grossi_op_6", 33,
+                          int_array, 16, &size));
+  printf("Concerti grossi:");
+  for (i = 0; i < size; i++)
+    printf(" %d", int_array[i]);
+  printf("\n");
+
+  /*** Errors ***/
+
+  /* No error aborts the program or crosses the interface: a status code is
+     returned and the message is available. */
+  status = ops_get_int(ops, "last_name", 9, &integer);
+  printf("Status %d: %s\n", status, ops_error_message(ops));
+
+  CHECK(ops_exists(ops, "Show_compositions", 17, &exists));
+  printf("Show_compositions exists: %d\n", exists);
+
+  /*** Functions ***/
+
+  /* A function is looked up once and may then be called repeatedly. */
+  CHECK(ops_function_open(ops, "sum_product", 11, &sum_product));
+  for (i = 0; i < 2; i++)
+    {
+      in[0] = (double) i;
+      CHECK(ops_function_call(sum_product, in, 3, out, 2, &size));
+      printf("sum_product(%g, %g, %g) = %g, %g\n", in[0], in[1], in[2],
+             out[0], out[1]);
+    }
+  ops_function_close(sum_product);
+
+  /*** What was read in the configuration file? ***/
+
+  CHECK(ops_write_lua_definition(ops, "what_was_read_c.lua", 19));
+  remove("what_was_read_c.lua");
+
+  ops_destroy(ops);
+
+  return 0;
+}
@@ -0,0 +1,6 @@
+-- This file is run on the first access to the table it defines (see
+-- 'ops.lazy' in example.cpp). It may also define the table by name.
+return {
+   messiah = {year = 1741, parts = 3},
+   solomon = {year = 1748, parts = 3}
+}
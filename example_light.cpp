@@ -0,0 +1,31 @@
+#include <iostream>
+using namespace std;
+
+// This header does not include Lua nor the templates of Ops. The methods are
+// compiled in the library.
+#include "OpsLight.hxx"
+
+
+int main()
+{
+  int integer;
+  vector<int> int_vector;
+
+  Ops::OpsLight ops("example.lua");
+
+  cout << "Last name: " << ops.Get<string>("last_name") << endl;
+
+  ops.Set("death_age", "v >= 0 and v < 150", integer);
+  cout << "Death age: " << integer << endl;
+
+  ops.Set("compositions.concerti_grossi_op_6", "v < 13", int_vector);
+  cout << "Number of concerti grossi: " << int_vector.size() << endl;
+
+  bool show = ops.Get<bool>("Show_compositions", "", true);
+  cout << "Show compositions: " << show << endl;
+
+  cout << "Call to function \"sum\": " << ops.Apply("sum", 1., 2., 3.)
+       << endl;
+
+  return 0;
+}
@@ -19,8 +19,574 @@
 %module ops
 %{
 #include "OpsHeader.hxx"
+#include "Journal.hxx"
+#include <climits>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+  // Releases the GIL for the lifetime of the object. The GIL is acquired
+  // again in the destructor, so that it is held again when an exception
+  // thrown by Ops reaches the 'catch' blocks of '%exception'.
+  class OpsAllowThreads
+  {
+  private:
+    PyThreadState* state_;
+  public:
+    OpsAllowThreads(): state_(PyEval_SaveThread())
+    {
+    }
+    ~OpsAllowThreads()
+    {
+      PyEval_RestoreThread(state_);
+    }
+  };
+
+  // Mutexes attached to the 'Ops' objects, and the mutex that protects
+  // their map.
+  static std::mutex ops_object_map_mutex;
+  static std::map<const void*, std::mutex> ops_object_mutex;
+
+  // Returns the mutex that serializes the calls made on 'object' while the
+  // GIL is released. It must be locked without holding the GIL.
+  std::mutex& OpsObjectMutex(const void* object)
+  {
+    std::lock_guard<std::mutex> lock(ops_object_map_mutex);
+    return ops_object_mutex[object];
+  }
+
+
+  // Removes the mutex attached to 'object', which is being destroyed: no
+  // other thread holds a reference to it, hence no thread uses its mutex.
+  void OpsReleaseObjectMutex(const void* object)
+  {
+    std::lock_guard<std::mutex> lock(ops_object_map_mutex);
+    ops_object_mutex.erase(object);
+  }
+
+
+#if PY_MAJOR_VERSION >= 3
+#define OPS_PY_STRING(s, n) PyUnicode_DecodeUTF8(s, n, "surrogateescape")
+#else
+#define OPS_PY_STRING(s, n) PyString_FromStringAndSize(s, n)
+#endif
+
+
+  // Checks whether a Lua number holds an integer that a 64-bit integer
+  // represents exactly.
+  bool OpsIsIntegral(lua_Number number)
+  {
+    return number == std::floor(number) && std::fabs(number) < 9007199254740992.;
+  }
+
+
+  // Converts a Lua number to a Python integer if it is integral, or to a
+  // Python float otherwise.
+  PyObject* OpsNumberToPython(lua_Number number)
+  {
+    if (OpsIsIntegral(number))
+      return PyLong_FromLongLong(static_cast<long long>(number));
+    return PyFloat_FromDouble(static_cast<double>(number));
+  }
+
+
+  PyObject* OpsTableToPython(lua_State* state, int index,
+                             std::vector<const void*>& table_path,
+                             PyObject* frombuffer, bool as_mapping,
+                             bool skip_library);
+
+
+  // Converts the value at 'index' in the Lua stack to a Python object. If the
+  // value has no Python counterpart (function, userdata, thread, or table
+  // that contains itself), NULL is returned without setting a Python error.
+  PyObject* OpsToPython(lua_State* state, int index,
+                        std::vector<const void*>& table_path,
+                        PyObject* frombuffer)
+  {
+    size_t length;
+    const char* string;
+    switch (lua_type(state, index))
+      {
+      case LUA_TBOOLEAN:
+        return PyBool_FromLong(lua_toboolean(state, index));
+      case LUA_TNUMBER:
+        return OpsNumberToPython(lua_tonumber(state, index));
+      case LUA_TSTRING:
+        string = lua_tolstring(state, index, &length);
+        return OPS_PY_STRING(string, static_cast<Py_ssize_t>(length));
+      case LUA_TTABLE:
+        return OpsTableToPython(state, index, table_path, frombuffer,
+                                false, false);
+      default:
+        return NULL;
+      }
+  }
+
+
+  // Converts the Lua table at 'index' in the Lua stack to a Python object.
+  // The table is traversed once. A sequence of numbers is converted to a
+  // NumPy array if 'frombuffer' (that is, 'numpy.frombuffer') is not NULL,
+  // and to a list otherwise. Other sequences are converted to lists, unless
+  // 'as_mapping' is true. Remaining tables are converted to dictionaries,
+  // from which the entries without Python counterpart are omitted. If
+  // 'skip_library' is true, the modules registered in 'package.loaded' (the
+  // standard libraries) and '_VERSION' are omitted as well.
+  PyObject* OpsTableToPython(lua_State* state, int index,
+                             std::vector<const void*>& table_path,
+                             PyObject* frombuffer, bool as_mapping,
+                             bool skip_library)
+  {
+    if (index < 0 && index > LUA_REGISTRYINDEX)
+      index = lua_gettop(state) + index + 1;
+
+    const void* table = lua_topointer(state, index);
+    if (std::find(table_path.begin(), table_path.end(), table)
+        != table_path.end())
+      return NULL;
+    if (!lua_checkstack(state, 4))
+      {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Lua stack overflow while converting a table.");
+        return NULL;
+      }
+
+    // First pass: is the table a sequence, and a sequence of numbers?
+    std::size_t length = OPS_LUA_RAWLEN(state, index);
+    std::size_t count = 0;
+    bool sequence = length != 0 && !as_mapping;
+    bool numeric = true, integral = true;
+    lua_pushnil(state);
+    while (sequence && lua_next(state, index) != 0)
+      {
+        count++;
+        lua_Number key = lua_tonumber(state, -2);
+        if (lua_type(state, -2) != LUA_TNUMBER || key != std::floor(key)
+            || key < 1. || key > static_cast<lua_Number>(length))
+          sequence = false;
+        if (lua_type(state, -1) != LUA_TNUMBER)
+          numeric = false;
+        else if (!OpsIsIntegral(lua_tonumber(state, -1)))
+          integral = false;
+        lua_pop(state, 1);
+      }
+    if (!sequence)
+      lua_settop(state, index);
+    sequence = sequence && count == length;
+
+    table_path.push_back(table);
+    PyObject* output = NULL;
+
+    if (sequence && numeric && frombuffer != NULL)
+      {
+        PyObject* buffer = PyByteArray_FromStringAndSize(NULL,
+                                                         static_cast<Py_ssize_t>(8 * length));
+        if (buffer != NULL)
+          {
+            char* data = PyByteArray_AS_STRING(buffer);
+            for (std::size_t i = 0; i < length; i++)
+              {
+                lua_rawgeti(state, index, static_cast<int>(i + 1));
+                if (integral)
+                  reinterpret_cast<long long*>(data)[i]
+                    = static_cast<long long>(lua_tonumber(state, -1));
+                else
+                  reinterpret_cast<double*>(data)[i]
+                    = static_cast<double>(lua_tonumber(state, -1));
+                lua_pop(state, 1);
+              }
+            output = PyObject_CallFunction(frombuffer, const_cast<char*>("Os"),
+                                           buffer,
+                                           integral ? "int64" : "float64");
+            Py_DECREF(buffer);
+          }
+      }
+    else if (sequence)
+      {
+        output = PyList_New(static_cast<Py_ssize_t>(length));
+        for (std::size_t i = 0; output != NULL && i < length; i++)
+          {
+            lua_rawgeti(state, index, static_cast<int>(i + 1));
+            PyObject* element = OpsToPython(state, -1, table_path, frombuffer);
+            lua_pop(state, 1);
+            if (element == NULL && PyErr_Occurred())
+              Py_CLEAR(output);
+            else if (element == NULL)
+              {
+                Py_INCREF(Py_None);
+                PyList_SET_ITEM(output, static_cast<Py_ssize_t>(i), Py_None);
+              }
+            else
+              PyList_SET_ITEM(output, static_cast<Py_ssize_t>(i), element);
+          }
+      }
+    else
+      {
+        int loaded = 0;
+        if (skip_library)
+          {
+            lua_getfield(state, LUA_REGISTRYINDEX, "_LOADED");
+            loaded = lua_gettop(state);
+          }
+
+        output = PyDict_New();
+        lua_pushnil(state);
+        while (output != NULL && lua_next(state, index) != 0)
+          {
+            PyObject* key = NULL;
+            size_t key_length;
+            const char* key_string;
+            switch (lua_type(state, -2))
+              {
+              case LUA_TBOOLEAN:
+                key = PyBool_FromLong(lua_toboolean(state, -2));
+                break;
+              case LUA_TNUMBER:
+                key = OpsNumberToPython(lua_tonumber(state, -2));
+                break;
+              case LUA_TSTRING:
+                key_string = lua_tolstring(state, -2, &key_length);
+                if (skip_library)
+                  {
+                    lua_pushvalue(state, -2);
+                    lua_rawget(state, loaded);
+                    bool library = lua_rawequal(state, -1, -2)
+                      || std::string(key_string) == "_VERSION";
+                    lua_pop(state, 1);
+                    if (library)
+                      break;
+                  }
+                key = OPS_PY_STRING(key_string,
+                                    static_cast<Py_ssize_t>(key_length));
+                break;
+              default:
+                break;
+              }
+
+            PyObject* value = NULL;
+            if (key != NULL)
+              value = OpsToPython(state, -1, table_path, frombuffer);
+            if (value != NULL && PyDict_SetItem(output, key, value) != 0)
+              Py_CLEAR(output);
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            if (PyErr_Occurred())
+              Py_CLEAR(output);
+            lua_pop(state, 1);
+          }
+      }
+
+    table_path.pop_back();
+    lua_settop(state, index);
+    return output;
+  }
+
+
+  // An argument of 'ApplyArray': a buffer of doubles, or values converted to
+  // doubles.
+  struct OpsArrayArgument
+  {
+    Py_buffer view;
+    bool has_view;
+    std::vector<double> value;
+    const double* data;
+    std::size_t size;
+  };
+
+
+  // Arguments of 'ApplyArray'. The buffers are released in the destructor,
+  // which must be called while the GIL is held.
+  class OpsArrayArgumentList
+  {
+  public:
+    std::vector<OpsArrayArgument> argument;
+    ~OpsArrayArgumentList()
+    {
+      for (std::size_t i = 0; i < argument.size(); i++)
+        if (argument[i].has_view)
+          PyBuffer_Release(&argument[i].view);
+    }
+  };
+
+
+  // Reads an argument of 'ApplyArray': an object supporting the buffer
+  // protocol (e.g., a NumPy array), a sequence or a number. A contiguous
+  // buffer of doubles is used without copy. Returns false and sets a Python
+  // error if the conversion fails.
+  bool OpsReadArray(PyObject* object, OpsArrayArgument& argument)
+  {
+    argument.has_view = false;
+    if (PyObject_CheckBuffer(object))
+      {
+        if (PyObject_GetBuffer(object, &argument.view,
+                               PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) != 0)
+          return false;
+        argument.has_view = true;
+        std::string format = argument.view.format == NULL ? "B"
+          : argument.view.format;
+        if (!format.empty() && (format[0] == '@' || format[0] == '='))
+          format = format.substr(1);
+        const char* data = static_cast<const char*>(argument.view.buf);
+        argument.size = argument.view.itemsize == 0 ? 0
+          : std::size_t(argument.view.len / argument.view.itemsize);
+
+        if (format == "d")
+          {
+            argument.data = reinterpret_cast<const double*>(data);
+            return true;
+          }
+        argument.value.resize(argument.size);
+        bool supported = true;
+        for (std::size_t i = 0; supported && i < argument.size; i++)
+          if (format == "f")
+            argument.value[i] = reinterpret_cast<const float*>(data)[i];
+          else if (format == "i")
+            argument.value[i] = reinterpret_cast<const int*>(data)[i];
+          else if (format == "l")
+            argument.value[i] = double(reinterpret_cast<const long*>(data)[i]);
+          else if (format == "q")
+            argument.value[i]
+              = double(reinterpret_cast<const long long*>(data)[i]);
+          else
+            supported = false;
+        if (supported)
+          {
+            argument.data = argument.value.data();
+            return true;
+          }
+        // Other formats are read as sequences below.
+        PyBuffer_Release(&argument.view);
+        argument.has_view = false;
+      }
+
+    if (PySequence_Check(object))
+      {
+        PyObject* sequence = PySequence_Fast(object, "");
+        if (sequence == NULL)
+          return false;
+        argument.size = std::size_t(PySequence_Fast_GET_SIZE(sequence));
+        argument.value.resize(argument.size);
+        for (std::size_t i = 0; i < argument.size; i++)
+          argument.value[i] = PyFloat_AsDouble
+            (PySequence_Fast_GET_ITEM(sequence, Py_ssize_t(i)));
+        Py_DECREF(sequence);
+      }
+    else
+      {
+        argument.size = 1;
+        argument.value.assign(1, PyFloat_AsDouble(object));
+      }
+    argument.data = argument.value.data();
+    return PyErr_Occurred() == NULL;
+  }
+
+
+  // Converts the table entry 'name', already on the stack, to a Python
+  // object (see 'OpsTableToPython'). The prefix is prepended to 'name'. An
+  // empty name refers to the global table, from which the standard libraries
+  // are omitted. 'function' is the name of the calling method, for error
+  // messages. It must be called with the GIL and with the mutex of the
+  // object. The stack is cleared.
+  PyObject* OpsStackTableToPython(Ops::Ops& ops, const std::string& name,
+                                  const std::string& function,
+                                  bool as_mapping)
+  {
+    PyObject* frombuffer = NULL;
+    PyObject* numpy = PyImport_ImportModule("numpy");
+    if (numpy != NULL)
+      {
+        frombuffer = PyObject_GetAttrString(numpy, "frombuffer");
+        Py_DECREF(numpy);
+      }
+    PyErr_Clear();
+
+    std::string entry = ops.GetPrefix() + name;
+    lua_State* state = ops.GetState();
+
+    std::string error;
+    if (lua_isnil(state, -1))
+      error = " was not found.";
+    else if (!lua_istable(state, -1))
+      error = " does not contain other entries.";
+    if (!error.empty())
+      {
+        Py_XDECREF(frombuffer);
+        ops.ClearStack();
+        throw Ops::Error(function, "The entry \"" + entry + "\" in \""
+                         + ops.GetFilePath() + "\"" + error);
+      }
+
+    std::vector<const void*> table_path;
+    PyObject* output = OpsTableToPython(state, -1, table_path, frombuffer,
+                                        as_mapping, entry.empty());
+    Py_XDECREF(frombuffer);
+    ops.ClearStack();
+    return output;
+  }
+
+
+  // Converts the table entry 'name' to a Python object (see
+  // 'OpsStackTableToPython'). It must be called with the GIL, which is
+  // released while the object is locked and the entry is looked up.
+  PyObject* OpsTableEntryToPython(Ops::Ops& ops, const std::string& name,
+                                  const std::string& function,
+                                  bool as_mapping)
+  {
+    std::unique_ptr<OpsAllowThreads> allow_threads(new OpsAllowThreads);
+    std::lock_guard<std::mutex> lock(OpsObjectMutex(&ops));
+    ops.PutOnStack(ops.GetPrefix() + name);
+    // The Python objects are created with the GIL, the object being locked.
+    allow_threads.reset();
+    return OpsStackTableToPython(ops, name, function, as_mapping);
+  }
+
+
+  // A Boolean, a number or a string, exchanged with 'ApplyValue' while the
+  // GIL is released.
+  struct OpsScalar
+  {
+    int type;
+    double number;
+    std::string string;
+  };
+
+
+  // Converts a Python object to a scalar. Returns false and sets a Python
+  // error if the object is not None, a Boolean, a number or a string.
+  bool OpsToScalar(PyObject* object, OpsScalar& scalar)
+  {
+    if (object == Py_None)
+      scalar.type = LUA_TNIL;
+    else if (PyBool_Check(object))
+      {
+        scalar.type = LUA_TBOOLEAN;
+        scalar.number = object == Py_True ? 1. : 0.;
+      }
+    else if (PyBytes_Check(object))
+      {
+        scalar.type = LUA_TSTRING;
+        scalar.string.assign(PyBytes_AS_STRING(object),
+                             std::size_t(PyBytes_GET_SIZE(object)));
+      }
+#if PY_MAJOR_VERSION >= 3
+    else if (PyUnicode_Check(object))
+      {
+        Py_ssize_t length;
+        const char* string = PyUnicode_AsUTF8AndSize(object, &length);
+        if (string == NULL)
+          return false;
+        scalar.type = LUA_TSTRING;
+        scalar.string.assign(string, std::size_t(length));
+      }
+#endif
+    else if (PyNumber_Check(object))
+      {
+        scalar.type = LUA_TNUMBER;
+        scalar.number = PyFloat_AsDouble(object);
+        return PyErr_Occurred() == NULL;
+      }
+    else
+      {
+        PyErr_SetString(PyExc_TypeError, "The arguments of ApplyValue must be "
+                        "None, Booleans, numbers or strings.");
+        return false;
+      }
+    return true;
+  }
+
+
+  // Converts a scalar to a Python object.
+  PyObject* OpsScalarToPython(const OpsScalar& scalar)
+  {
+    switch (scalar.type)
+      {
+      case LUA_TBOOLEAN:
+        return PyBool_FromLong(scalar.number != 0.);
+      case LUA_TNUMBER:
+        return OpsNumberToPython(scalar.number);
+      case LUA_TSTRING:
+        return OPS_PY_STRING(scalar.string.data(),
+                             Py_ssize_t(scalar.string.size()));
+      default:
+        Py_RETURN_NONE;
+      }
+  }
+
+
+  // Calls the Lua function 'name' (with the prefix prepended) with the
+  // arguments 'in', and stores its returned values in 'out'. It does not use
+  // the Python API, so that it may be called without the GIL.
+  void OpsApplyScalar(Ops::Ops& ops, const std::string& name,
+                      const std::vector<OpsScalar>& in,
+                      std::vector<OpsScalar>& out)
+  {
+    lua_State* state = ops.GetState();
+    std::string function = "function \"" + ops.GetPrefix() + name + "\" in \""
+      + ops.GetFilePath() + "\"";
+    ops.PutOnStack(ops.GetPrefix() + name);
+    if (!lua_isfunction(state, -1))
+      {
+        ops.ClearStack();
+        throw Ops::Error("ApplyValue", "The " + function + " was not found.");
+      }
+    int top = lua_gettop(state) - 1;
+    if (!lua_checkstack(state, int(in.size()) + 1))
+      throw Ops::Error("ApplyValue", "Too many arguments for the "
+                       + function + ".");
+
+    for (std::size_t i = 0; i < in.size(); i++)
+      if (in[i].type == LUA_TBOOLEAN)
+        lua_pushboolean(state, in[i].number != 0.);
+      else if (in[i].type == LUA_TNUMBER)
+        lua_pushnumber(state, lua_Number(in[i].number));
+      else if (in[i].type == LUA_TSTRING)
+        lua_pushlstring(state, in[i].string.data(), in[i].string.size());
+      else
+        lua_pushnil(state);
+
+    if (lua_pcall(state, int(in.size()), LUA_MULTRET, 0) != 0)
+      {
+        std::string message = lua_tostring(state, -1);
+        ops.ClearStack();
+        throw Ops::Error("ApplyValue", "While calling " + function + ":\n  "
+                         + message);
+      }
+
+    out.resize(std::size_t(lua_gettop(state) - top));
+    for (std::size_t i = 0; i < out.size(); i++)
+      {
+        int index = top + 1 + int(i);
+        out[i].type = lua_type(state, index);
+        if (out[i].type == LUA_TBOOLEAN)
+          out[i].number = lua_toboolean(state, index);
+        else if (out[i].type == LUA_TNUMBER)
+          out[i].number = double(lua_tonumber(state, index));
+        else if (out[i].type == LUA_TSTRING)
+          {
+            size_t length;
+            const char* string = lua_tolstring(state, index, &length);
+            out[i].string.assign(string, length);
+          }
+        else if (out[i].type != LUA_TNIL)
+          {
+            std::ostringstream str;
+            str << i;
+            ops.ClearStack();
+            throw Ops::Error("ApplyValue", "The returned value #" + str.str()
+                             + " of the " + function + " is not a Boolean, "
+                             "a number or a string.");
+          }
+      }
+    ops.ClearStack();
+  }
   %}
 
+%init
+%{
+#if PY_VERSION_HEX < 0x03070000
+  PyEval_InitThreads();
+#endif
+%}
+
 %include "typemaps.i"
 %include "std_string.i"
 %include "std_vector.i"
@@ -69,7 +635,146 @@ namespace std
     }
 }
 
+// Thread safety. The methods below may run Lua code or perform I/O for a
+// long time, so they release the GIL: other Python threads keep running
+// meanwhile. Distinct 'Ops' objects may then be used concurrently from
+// different threads. Calls to the methods below on a single 'Ops' object are
+// serialized by a mutex attached to the object. The methods that modify the
+// state of the object (e.g., 'SetRawAccess') are in the list, even if they
+// are short. The prefix is the exception: 'SetPrefix' and 'ClearPrefix' are
+// not protected, so an 'Ops' object whose prefix is modified should not be
+// shared between threads.
+%define OPS_RELEASE_GIL(method)
+%exception Ops::Ops::method
+{
+  try
+    {
+      OpsAllowThreads allow_threads;
+      std::lock_guard<std::mutex> lock(OpsObjectMutex(arg1));
+      $action
+    }
+  catch(Ops::Error& e)
+    {
+      PyErr_SetString(PyExc_Exception, e.What().c_str());
+      return NULL;
+    }
+  catch(std::exception& e)
+    {
+      PyErr_SetString(PyExc_Exception, e.what());
+      return NULL;
+    }
+  catch(...)
+    {
+      PyErr_SetString(PyExc_Exception, "Unknown exception...");
+      return NULL;
+    }
+}
+%enddef
+
+// The constructor may open a configuration file. The object is not yet
+// visible to other threads, so no lock is needed.
+%exception Ops::Ops::Ops
+{
+  try
+    {
+      OpsAllowThreads allow_threads;
+      $action
+    }
+  catch(Ops::Error& e)
+    {
+      PyErr_SetString(PyExc_Exception, e.What().c_str());
+      return NULL;
+    }
+  catch(std::exception& e)
+    {
+      PyErr_SetString(PyExc_Exception, e.what());
+      return NULL;
+    }
+  catch(...)
+    {
+      PyErr_SetString(PyExc_Exception, "Unknown exception...");
+      return NULL;
+    }
+}
+
+OPS_RELEASE_GIL(Open);
+OPS_RELEASE_GIL(Reload);
+OPS_RELEASE_GIL(Close);
+OPS_RELEASE_GIL(DoFile);
+OPS_RELEASE_GIL(DoString);
+OPS_RELEASE_GIL(Get);
+OPS_RELEASE_GIL(Apply);
+OPS_RELEASE_GIL(Is);
+OPS_RELEASE_GIL(IsTable);
+OPS_RELEASE_GIL(IsFunction);
+OPS_RELEASE_GIL(Exists);
+OPS_RELEASE_GIL(GetEntryList);
+OPS_RELEASE_GIL(CheckConstraint);
+OPS_RELEASE_GIL(CheckConstraintOnValue);
+OPS_RELEASE_GIL(UpdateLuaDefinition);
+OPS_RELEASE_GIL(LuaDefinition);
+OPS_RELEASE_GIL(WriteLuaDefinition);
+OPS_RELEASE_GIL(Serialize);
+OPS_RELEASE_GIL(Deserialize);
+OPS_RELEASE_GIL(WriteSnapshot);
+OPS_RELEASE_GIL(ReadSnapshot);
+OPS_RELEASE_GIL(OpenBroadcast);
+OPS_RELEASE_GIL(Override);
+OPS_RELEASE_GIL(OpenJournal);
+OPS_RELEASE_GIL(CloseJournal);
+OPS_RELEASE_GIL(ReplayJournal);
+OPS_RELEASE_GIL(Validate);
+OPS_RELEASE_GIL(ValidateAsync);
+OPS_RELEASE_GIL(SetDeferredValidation);
+OPS_RELEASE_GIL(SetRawAccess);
+OPS_RELEASE_GIL(ClearInheritanceCache);
+OPS_RELEASE_GIL(GetReadEntryList);
+OPS_RELEASE_GIL(WriteLuaDefinitionAsync);
+OPS_RELEASE_GIL(StartProfiler);
+OPS_RELEASE_GIL(StopProfiler);
+OPS_RELEASE_GIL(StartApplyPool);
+OPS_RELEASE_GIL(StopApplyPool);
+
+// The serialized configurations are binary buffers: they are exchanged as
+// 'bytes' objects.
+%typemap(out) std::string Serialize
+{
+  $result = PyBytes_FromStringAndSize($1.data(), Py_ssize_t($1.size()));
+}
+%typemap(in) const std::string& buffer (std::string temp)
+{
+  char* data;
+  Py_ssize_t size;
+  if (PyBytes_AsStringAndSize($input, &data, &size) != 0)
+    SWIG_fail;
+  temp.assign(data, std::size_t(size));
+  $1 = &temp;
+}
+%typemap(typecheck) const std::string& buffer
+{
+  $1 = PyBytes_Check($input) ? 1 : 0;
+}
+
+// 'ApplyArray' is replaced below by a method that takes NumPy arrays.
+%ignore Ops::Ops::ApplyArray(std::string, int, const double* const*,
+                             std::size_t, double*);
+%feature("shadow") Ops::Ops::ApplyArray(std::string, PyObject*)
+%{
+def ApplyArray(self, name, *arrays):
+    return $action(self, name, arrays)
+%}
+
+%feature("shadow") Ops::Ops::ApplyValue(std::string, PyObject*)
+%{
+def ApplyValue(self, name, *args):
+    return $action(self, name, args)
+%}
+
 %include "OpsHeader.hxx"
+%include "PhaseReport.hxx"
+%template(VectPhaseReport) std::vector<Ops::PhaseReport>;
+%include "Profiler.hxx"
+%include "Journal.hxx"
 %include "ClassOps.hxx"
 
 
@@ -77,6 +782,7 @@ namespace std
 %template(Get ## suffix) Get<type >;
 %template(Apply ## suffix) Apply<type >;
 %template(Is ## suffix) Is<type >;
+%template(Override ## suffix) Override<type >;
 %enddef
 
 %define OPS_INSTANTIATE_CROSSED_ELEMENT(suffix0, type0, suffix1, type1)
@@ -86,6 +792,7 @@ namespace std
 %define OPS_INSTANTIATE_VECTOR(suffix, type)
 %template(Get ## suffix) Get<type >;
 %template(Is ## suffix) Is<type >;
+%template(Override ## suffix) Override<type >;
 %enddef
 
 namespace Ops
@@ -93,6 +800,10 @@ namespace Ops
 
   %extend Ops
   {
+    // The typed methods are not available in the lean module, which only
+    // provides the dynamically typed 'GetValue' and 'ApplyValue' (and the
+    // typed vector access).
+#ifndef OPS_LEAN
     OPS_INSTANTIATE_ELEMENT(Bool, bool);
     OPS_INSTANTIATE_ELEMENT(Int, int);
     OPS_INSTANTIATE_ELEMENT(Float, float);
@@ -123,11 +834,196 @@ namespace Ops
     OPS_INSTANTIATE_CROSSED_ELEMENT(Float, float, String, string);
     OPS_INSTANTIATE_CROSSED_ELEMENT(Double, double, String, string);
     OPS_INSTANTIATE_CROSSED_ELEMENT(String, string, String, string);
+#endif
     OPS_INSTANTIATE_VECTOR(VectBool, std::vector<bool>);
     OPS_INSTANTIATE_VECTOR(VectInt, std::vector<int>);
     OPS_INSTANTIATE_VECTOR(VectFloat, std::vector<float>);
     OPS_INSTANTIATE_VECTOR(VectDouble, std::vector<double>);
     OPS_INSTANTIATE_VECTOR(VectString, std::vector<string>);
+
+    // The mutex attached to the object is removed with it, so that it is not
+    // inherited by an object created later at the same address.
+    ~Ops()
+    {
+      OpsReleaseObjectMutex($self);
+      delete $self;
+    }
+
+    // Exports all entries under 'root' into a dictionary, in a single
+    // traversal of the Lua tables. Sequences of numbers are exported as NumPy
+    // arrays (or lists if NumPy is not installed), other sequences as lists
+    // and other tables as dictionaries. Functions are omitted. The prefix is
+    // prepended to 'root'. The entries are not recorded as read.
+    PyObject* ToDict(std::string root = "")
+    {
+      return OpsTableEntryToPython(*$self, root, "ToDict", true);
+    }
+
+    // Returns the value of an entry, converted to the Python type that
+    // matches its Lua type: Boolean, integer, float or string. Tables are
+    // converted as in 'ToDict', except that sequences are not converted to
+    // dictionaries. Unlike the other values, tables are not recorded as read.
+    // The prefix is prepended to 'name'.
+    PyObject* GetValue(std::string name)
+    {
+      // The entry is looked up once, without the GIL. The GIL is acquired
+      // again, the object being locked, to convert a table.
+      std::unique_ptr<OpsAllowThreads> allow_threads(new OpsAllowThreads);
+      std::lock_guard<std::mutex> lock(OpsObjectMutex($self));
+      $self->PutOnStack($self->GetPrefix() + name);
+      if (lua_istable($self->GetState(), -1))
+        {
+          allow_threads.reset();
+          return OpsStackTableToPython(*$self, name, "GetValue", false);
+        }
+      Ops::Value value = $self->GetOnStack(name);
+      allow_threads.reset();
+
+      if (std::holds_alternative<bool>(value))
+        return PyBool_FromLong(std::get<bool>(value));
+      if (std::holds_alternative<int>(value))
+        return PyLong_FromLong(std::get<int>(value));
+      if (std::holds_alternative<double>(value))
+        return OpsNumberToPython(std::get<double>(value));
+      const std::string& string = std::get<std::string>(value);
+      return OPS_PY_STRING(string.data(), Py_ssize_t(string.size()));
+    }
+
+    // Applies a Lua function to Booleans, numbers or strings. The type of the
+    // arguments and of the returned values is determined at run time. The
+    // function returns None, its single returned value, or a tuple of its
+    // returned values. The function runs without the GIL.
+    PyObject* ApplyValue(std::string name, PyObject* args)
+    {
+      std::vector<OpsScalar> in(std::size_t(PyTuple_Size(args))), out;
+      for (std::size_t i = 0; i < in.size(); i++)
+        if (!OpsToScalar(PyTuple_GET_ITEM(args, Py_ssize_t(i)), in[i]))
+          return NULL;
+
+      {
+        OpsAllowThreads allow_threads;
+        std::lock_guard<std::mutex> lock(OpsObjectMutex($self));
+        OpsApplyScalar(*$self, name, in, out);
+      }
+
+      if (out.empty())
+        Py_RETURN_NONE;
+      if (out.size() == 1)
+        return OpsScalarToPython(out[0]);
+      PyObject* output = PyTuple_New(Py_ssize_t(out.size()));
+      for (std::size_t i = 0; output != NULL && i < out.size(); i++)
+        {
+          PyObject* element = OpsScalarToPython(out[i]);
+          if (element == NULL)
+            Py_CLEAR(output);
+          else
+            PyTuple_SET_ITEM(output, Py_ssize_t(i), element);
+        }
+      return output;
+    }
+
+    // Applies a Lua function elementwise to arrays: 'ApplyArray(name, x,
+    // y)' returns an array 'z' so that 'z[i] = name(x[i], y[i])'. The
+    // arguments may be NumPy arrays (of the same size), sequences or numbers
+    // (which are broadcast). The output is a NumPy array of doubles, or a list
+    // if NumPy is not available. The loop runs without the GIL.
+    PyObject* ApplyArray(std::string name, PyObject* arrays)
+    {
+      Py_ssize_t Narg = PyTuple_Size(arrays);
+      if (Narg < 1)
+        {
+          PyErr_SetString(PyExc_TypeError,
+                          "ApplyArray expects at least one array.");
+          return NULL;
+        }
+
+      OpsArrayArgumentList list;
+      list.argument.resize(std::size_t(Narg));
+      std::size_t size = 1;
+      for (Py_ssize_t i = 0; i < Narg; i++)
+        {
+          OpsArrayArgument& argument = list.argument[std::size_t(i)];
+          if (!OpsReadArray(PyTuple_GET_ITEM(arrays, i), argument))
+            return NULL;
+          if (argument.size == 1)
+            continue;
+          if (size != 1 && size != argument.size)
+            {
+              PyErr_SetString(PyExc_ValueError,
+                              "The arrays given to ApplyArray do not have "
+                              "the same size.");
+              return NULL;
+            }
+          size = argument.size;
+        }
+
+      // Broadcasts the single values.
+      std::vector<const double*> in(list.argument.size());
+      for (std::size_t i = 0; i < in.size(); i++)
+        {
+          OpsArrayArgument& argument = list.argument[i];
+          if (argument.size == 1 && size != 1)
+            {
+              argument.value.assign(size, argument.data[0]);
+              argument.data = argument.value.data();
+            }
+          in[i] = argument.data;
+        }
+
+      PyObject* output
+        = PyByteArray_FromStringAndSize(NULL, Py_ssize_t(sizeof(double) * size));
+      if (output == NULL)
+        return NULL;
+      double* out = reinterpret_cast<double*>(PyByteArray_AS_STRING(output));
+      try
+        {
+          OpsAllowThreads allow_threads;
+          std::lock_guard<std::mutex> lock(OpsObjectMutex($self));
+          $self->ApplyArray(name, int(Narg), in.data(), size, out);
+        }
+      catch(...)
+        {
+          Py_DECREF(output);
+          throw;
+        }
+
+      PyObject* result = NULL;
+      PyObject* numpy = PyImport_ImportModule("numpy");
+      if (numpy != NULL)
+        {
+          result = PyObject_CallMethod(numpy, const_cast<char*>("frombuffer"),
+                                       const_cast<char*>("Os"), output,
+                                       "float64");
+          Py_DECREF(numpy);
+        }
+      else
+        {
+          PyErr_Clear();
+          result = PyList_New(Py_ssize_t(size));
+          for (std::size_t i = 0; result != NULL && i < size; i++)
+            PyList_SET_ITEM(result, Py_ssize_t(i), PyFloat_FromDouble(out[i]));
+        }
+      Py_DECREF(output);
+      return result;
+    }
+
+    // An 'Ops' object is pickled as its serialized configuration, so that it
+    // is not evaluated again when unpickled (e.g., in the workers of
+    // 'multiprocessing'). The functions are preserved (see 'Serialize'), but
+    // not the prefix, which is cleared as in 'Open'.
+    %pythoncode
+    %{
+      def __reduce__(self):
+          return (_ops_deserialize, (self.Serialize(),))
+    %}
   };
 
 }
+
+%pythoncode
+%{
+def _ops_deserialize(buffer):
+    ops = Ops()
+    ops.Deserialize(buffer)
+    return ops
+%}
@@ -0,0 +1,620 @@
+// Copyright (C) 2010, Vivien Mallet
+//
+// This file is part of Ops, a library for parsing Lua configuration files.
+//
+// Ops is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation; either version 2.1 of the License, or (at your option)
+// any later version.
+//
+// Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+// more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with Ops. If not, see http://www.gnu.org/licenses/.
+
+
+#ifndef OPS_FILE_OPS_C_CXX
+
+#include "OpsHeader.hxx"
+#include "ops_c.h"
+
+#include <set>
+
+
+//! Configuration behind the C interface.
+/*! It derives from 'Ops::Ops' so that the entries are read in a single
+  lookup and recorded as read, without going through the methods that raise
+  'Ops::Error'. Hence the C interface reports errors with status codes even
+  if Ops aborts on errors.
+*/
+struct ops_handle_t: public Ops::Ops
+{
+  //! Message of the last error.
+  std::string error;
+  //! Number of times the Lua state was replaced, to detect outdated
+  //! functions.
+  int generation;
+  //! Functions opened and not closed yet, invalidated on destruction.
+  std::set<ops_function_t*> function_list;
+
+  ops_handle_t(): generation(0)
+  {
+  }
+
+  //! Records an error.
+  /*!
+    \param[in] status the status code.
+    \param[in] message the error message.
+    \return The status code.
+  */
+  int Fail(int status, const std::string& message)
+  {
+    error = message;
+    ClearStack();
+    return status;
+  }
+
+  //! Runs a chunk loaded on top of the stack, or reports the loading error.
+  /*!
+    \param[in] load_status the value returned by the loading function.
+    \return The status code.
+  */
+  int Run(int load_status)
+  {
+    if (load_status != 0 || lua_pcall(state_, 0, LUA_MULTRET, 0) != 0)
+      return Fail(OPS_ERROR_LUA, lua_tostring(state_, -1));
+    ClearStack();
+    return OPS_OK;
+  }
+
+  //! Opens a configuration file in a new Lua state.
+  /*! See 'Ops::Open': the prefix is cleared, and the phases are recorded if
+    the open report is enabled.
+    \param[in] file_path path to the configuration file.
+    \return The status code.
+  */
+  int OpenFile(std::string file_path)
+  {
+    generation++;
+    if (TryOpen(file_path, true) != 0)
+      return Fail(OPS_ERROR_LUA, lua_tostring(state_, -1));
+    ClearStack();
+    return OPS_OK;
+  }
+
+  //! Puts an entry on top of the stack.
+  /*!
+    \param[in] name name of the entry, to which the prefix is prepended.
+    \return OPS_OK, or OPS_ERROR_NOT_FOUND if the entry does not exist.
+  */
+  int Find(const std::string& name)
+  {
+    PutOnStack(Name(name));
+    if (lua_isnil(state_, -1))
+      return Fail(OPS_ERROR_NOT_FOUND, "The " + Entry(name)
+                  + " was not found.");
+    return OPS_OK;
+  }
+
+  //! Reads a scalar entry and records it as read.
+  /*!
+    \param[in] name name of the entry.
+    \param[out] value value of the entry.
+    \return The status code.
+  */
+  template<class T>
+  int GetScalar(const std::string& name, T& value)
+  {
+    int status = Find(name);
+    if (status != OPS_OK)
+      return status;
+    if (!Convert(-1, value))
+      return Fail(OPS_ERROR_TYPE, "The " + Entry(name)
+                  + " does not have the requested type.");
+    ClearStack();
+    Push(Name(name), value);
+    return OPS_OK;
+  }
+
+  //! Reads a sequence into a buffer and records it as read.
+  /*! The elements 1, 2, ... of the Lua table are read until the first nil.
+    \param[in] name name of the entry.
+    \param[out] buffer the buffer.
+    \param[in] capacity the number of elements that \a buffer can hold.
+    \param[out] size the number of elements of the entry. If it is greater
+    than \a capacity, nothing is read and OPS_ERROR_BUFFER is returned.
+    \return The status code.
+  */
+  template<class T>
+  int GetArray(const std::string& name, T* buffer, size_t capacity,
+               size_t* size)
+  {
+    int status = Find(name);
+    if (status != OPS_OK)
+      return status;
+    if (!lua_istable(state_, -1))
+      return Fail(OPS_ERROR_TYPE, "The " + Entry(name) + " is not a table.");
+
+    *size = OPS_LUA_RAWLEN(state_, -1);
+    if (*size > capacity)
+      return Fail(OPS_ERROR_BUFFER, "The buffer is too small for the "
+                  + Entry(name) + ".");
+
+    std::vector<T> value(*size);
+    for (size_t i = 0; i < *size; i++)
+      {
+        lua_rawgeti(state_, -1, int(i + 1));
+        if (!Convert(-1, value[i]))
+          return Fail(OPS_ERROR_TYPE, "The elements of the " + Entry(name)
+                      + " do not have the requested type.");
+        lua_pop(state_, 1);
+        buffer[i] = value[i];
+      }
+    ClearStack();
+    Push(Name(name), value);
+    return OPS_OK;
+  }
+
+  using Ops::Ops::Convert;
+  using Ops::Ops::Entry;
+  using Ops::Ops::Function;
+  using Ops::Ops::Name;
+};
+
+
+//! Lua function behind the C interface.
+struct ops_function_t
+{
+  //! The configuration in which the function is defined.
+  ops_handle_t* handle;
+  //! Generation of the Lua state in which the function was looked up.
+  int generation;
+  //! Reference to the function in the Lua registry.
+  int reference;
+  //! Name of the function, for error messages.
+  std::string name;
+};
+
+
+//! Converts the exceptions into status codes.
+#define OPS_C_TRY(handle)                                       \
+  if (handle == NULL)                                           \
+    return OPS_ERROR_ARGUMENT;                                  \
+  try                                                           \
+    {
+#define OPS_C_CATCH(handle)                                     \
+    }                                                           \
+  catch(Ops::Error& e)                                          \
+    {                                                           \
+      return handle->Fail(OPS_ERROR_OTHER, e.What());           \
+    }                                                           \
+  catch(std::exception& e)                                      \
+    {                                                           \
+      return handle->Fail(OPS_ERROR_OTHER, e.what());           \
+    }                                                           \
+  catch(...)                                                    \
+    {                                                           \
+      return handle->Fail(OPS_ERROR_OTHER, "Unknown error.");   \
+    }
+
+
+extern "C"
+{
+
+
+  //! Returns the version of the C interface.
+  /*!
+    \return The version, OPS_C_API_VERSION at compile time of the library.
+  */
+  int ops_c_api_version(void)
+  {
+    return OPS_C_API_VERSION;
+  }
+
+
+  //! Creates a configuration with an empty Lua state.
+  /*!
+    \param[out] handle the new configuration, to be destroyed with
+    'ops_destroy'.
+    \return The status code.
+  */
+  int ops_create(ops_handle_t** handle)
+  {
+    if (handle == NULL)
+      return OPS_ERROR_ARGUMENT;
+    try
+      {
+        *handle = new ops_handle_t;
+      }
+    catch(...)
+      {
+        *handle = NULL;
+        return OPS_ERROR_OTHER;
+      }
+    return OPS_OK;
+  }
+
+
+  //! Destroys a configuration.
+  /*! The functions opened on \a handle and not closed yet are invalidated:
+    they may only be passed to 'ops_function_close'.
+    \param[in] handle the configuration. It may be null.
+  */
+  void ops_destroy(ops_handle_t* handle)
+  {
+    if (handle == NULL)
+      return;
+    for (std::set<ops_function_t*>::iterator i
+           = handle->function_list.begin();
+         i != handle->function_list.end(); ++i)
+      (*i)->handle = NULL;
+    delete handle;
+  }
+
+
+  //! Returns the message of the last error.
+  /*!
+    \param[in] handle the configuration.
+    \return The message, valid until the next call on \a handle.
+  */
+  const char* ops_error_message(const ops_handle_t* handle)
+  {
+    if (handle == NULL)
+      return "Null handle.";
+    return handle->error.c_str();
+  }
+
+
+  //! Opens a configuration file.
+  /*! The previous Lua state is closed: the functions opened on \a handle are
+    no longer valid.
+    \param[in] handle the configuration.
+    \param[in] path path to the configuration file.
+    \param[in] path_length length of \a path.
+    \return The status code.
+  */
+  int ops_open(ops_handle_t* handle, const char* path, size_t path_length)
+  {
+    OPS_C_TRY(handle);
+    return handle->OpenFile(std::string(path, path_length));
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Executes a Lua file.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] path path to the Lua file.
+    \param[in] path_length length of \a path.
+    \return The status code.
+  */
+  int ops_do_file(ops_handle_t* handle, const char* path, size_t path_length)
+  {
+    OPS_C_TRY(handle);
+    std::string file_path(path, path_length);
+    return handle->Run(luaL_loadfile(handle->GetState(), file_path.c_str()));
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Executes Lua code.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] code the Lua code.
+    \param[in] code_length length of \a code.
+    \return The status code.
+  */
+  int ops_do_string(ops_handle_t* handle, const char* code,
+                    size_t code_length)
+  {
+    OPS_C_TRY(handle);
+    return handle->Run(luaL_loadbuffer(handle->GetState(), code, code_length,
+                                       "ops_do_string"));
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Sets the prefix prepended to the entry names.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] prefix the prefix.
+    \param[in] prefix_length length of \a prefix.
+    \return The status code.
+  */
+  int ops_set_prefix(ops_handle_t* handle, const char* prefix,
+                     size_t prefix_length)
+  {
+    OPS_C_TRY(handle);
+    handle->SetPrefix(std::string(prefix, prefix_length));
+    return OPS_OK;
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Checks whether an entry exists.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] name name of the entry.
+    \param[in] name_length length of \a name.
+    \param[out] exists 1 if the entry exists, 0 otherwise.
+    \return The status code.
+  */
+  int ops_exists(ops_handle_t* handle, const char* name, size_t name_length,
+                 int* exists)
+  {
+    OPS_C_TRY(handle);
+    *exists = handle->Exists(std::string(name, name_length)) ? 1 : 0;
+    return OPS_OK;
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Reads a Boolean.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] name name of the entry.
+    \param[in] name_length length of \a name.
+    \param[out] value 1 for true, 0 for false.
+    \return The status code.
+  */
+  int ops_get_bool(ops_handle_t* handle, const char* name, size_t name_length,
+                   int* value)
+  {
+    OPS_C_TRY(handle);
+    bool output;
+    int status = handle->GetScalar(std::string(name, name_length), output);
+    if (status == OPS_OK)
+      *value = output ? 1 : 0;
+    return status;
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Reads an integer.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] name name of the entry.
+    \param[in] name_length length of \a name.
+    \param[out] value the value of the entry.
+    \return The status code.
+  */
+  int ops_get_int(ops_handle_t* handle, const char* name, size_t name_length,
+                  int* value)
+  {
+    OPS_C_TRY(handle);
+    return handle->GetScalar(std::string(name, name_length), *value);
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Reads a double.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] name name of the entry.
+    \param[in] name_length length of \a name.
+    \param[out] value the value of the entry.
+    \return The status code.
+  */
+  int ops_get_double(ops_handle_t* handle, const char* name,
+                     size_t name_length, double* value)
+  {
+    OPS_C_TRY(handle);
+    return handle->GetScalar(std::string(name, name_length), *value);
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Reads a string.
+  /*! The string is null-terminated if \a capacity is greater than its
+    length.
+    \param[in] handle the configuration.
+    \param[in] name name of the entry.
+    \param[in] name_length length of \a name.
+    \param[out] buffer the buffer that receives the string.
+    \param[in] capacity the size of \a buffer.
+    \param[out] length the length of the string. If it is greater than \a
+    capacity, nothing is copied and OPS_ERROR_BUFFER is returned.
+    \return The status code.
+  */
+  int ops_get_string(ops_handle_t* handle, const char* name,
+                     size_t name_length, char* buffer, size_t capacity,
+                     size_t* length)
+  {
+    OPS_C_TRY(handle);
+    std::string value;
+    int status = handle->GetScalar(std::string(name, name_length), value);
+    if (status != OPS_OK)
+      return status;
+    *length = value.size();
+    if (value.size() > capacity)
+      return handle->Fail(OPS_ERROR_BUFFER, "The buffer is too small for the "
+                          + handle->Entry(std::string(name, name_length))
+                          + ".");
+    std::memcpy(buffer, value.data(), value.size());
+    if (value.size() < capacity)
+      buffer[value.size()] = '\0';
+    return OPS_OK;
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Reads an array of integers.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] name name of the entry.
+    \param[in] name_length length of \a name.
+    \param[out] buffer the buffer that receives the elements.
+    \param[in] capacity the number of elements that \a buffer can hold.
+    \param[out] size the number of elements. If it is greater than \a
+    capacity, nothing is copied and OPS_ERROR_BUFFER is returned.
+    \return The status code.
+  */
+  int ops_get_int_array(ops_handle_t* handle, const char* name,
+                        size_t name_length, int* buffer, size_t capacity,
+                        size_t* size)
+  {
+    OPS_C_TRY(handle);
+    return handle->GetArray(std::string(name, name_length), buffer, capacity,
+                            size);
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Reads an array of doubles.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] name name of the entry.
+    \param[in] name_length length of \a name.
+    \param[out] buffer the buffer that receives the elements.
+    \param[in] capacity the number of elements that \a buffer can hold.
+    \param[out] size the number of elements. If it is greater than \a
+    capacity, nothing is copied and OPS_ERROR_BUFFER is returned.
+    \return The status code.
+  */
+  int ops_get_double_array(ops_handle_t* handle, const char* name,
+                           size_t name_length, double* buffer,
+                           size_t capacity, size_t* size)
+  {
+    OPS_C_TRY(handle);
+    return handle->GetArray(std::string(name, name_length), buffer, capacity,
+                            size);
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Looks up a Lua function, to be called with 'ops_function_call'.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] name name of the function.
+    \param[in] name_length length of \a name.
+    \param[out] function the function, to be released with
+    'ops_function_close'.
+    \return The status code.
+  */
+  int ops_function_open(ops_handle_t* handle, const char* name,
+                        size_t name_length, ops_function_t** function)
+  {
+    OPS_C_TRY(handle);
+    std::string function_name(name, name_length);
+    int status = handle->Find(function_name);
+    if (status != OPS_OK)
+      return status;
+    lua_State* state = handle->GetState();
+    if (!lua_isfunction(state, -1))
+      return handle->Fail(OPS_ERROR_TYPE, "The entry \""
+                          + handle->Name(function_name)
+                          + "\" is not a function.");
+
+    *function = new ops_function_t;
+    (*function)->handle = handle;
+    (*function)->generation = handle->generation;
+    (*function)->reference = luaL_ref(state, LUA_REGISTRYINDEX);
+    (*function)->name = function_name;
+    handle->function_list.insert(*function);
+    handle->ClearStack();
+    return OPS_OK;
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Calls a Lua function with numbers.
+  /*!
+    \param[in] function the function.
+    \param[in] in the arguments.
+    \param[in] Nin the number of arguments.
+    \param[out] out the buffer that receives the returned values.
+    \param[in] capacity the number of values that \a out can hold.
+    \param[out] Nout the number of returned values. If it is greater than \a
+    capacity, nothing is copied and OPS_ERROR_BUFFER is returned.
+    \return The status code.
+  */
+  int ops_function_call(ops_function_t* function, const double* in,
+                        size_t Nin, double* out, size_t capacity,
+                        size_t* Nout)
+  {
+    if (function == NULL || function->handle == NULL)
+      return OPS_ERROR_ARGUMENT;
+    ops_handle_t* handle = function->handle;
+    if (function->generation != handle->generation)
+      return handle->Fail(OPS_ERROR_ARGUMENT, "The "
+                          + handle->Function(function->name)
+                          + " was looked up in a closed Lua state.");
+    OPS_C_TRY(handle);
+    lua_State* state = handle->GetState();
+    if (!lua_checkstack(state, int(Nin) + 1))
+      return handle->Fail(OPS_ERROR_ARGUMENT, "Too many arguments.");
+
+    int top = lua_gettop(state);
+    lua_rawgeti(state, LUA_REGISTRYINDEX, function->reference);
+    for (size_t i = 0; i < Nin; i++)
+      lua_pushnumber(state, lua_Number(in[i]));
+    if (lua_pcall(state, int(Nin), LUA_MULTRET, 0) != 0)
+      return handle->Fail(OPS_ERROR_LUA, "While calling "
+                          + handle->Function(function->name) + ":\n  "
+                          + lua_tostring(state, -1));
+
+    *Nout = size_t(lua_gettop(state) - top);
+    if (*Nout > capacity)
+      return handle->Fail(OPS_ERROR_BUFFER, "The buffer is too small for the "
+                          "values returned by the "
+                          + handle->Function(function->name) + ".");
+    for (size_t i = 0; i < *Nout; i++)
+      if (!handle->Convert(top + 1 + int(i), out[i]))
+        return handle->Fail(OPS_ERROR_TYPE, "The values returned by the "
+                            + handle->Function(function->name)
+                            + " are not all numbers.");
+    handle->ClearStack();
+    return OPS_OK;
+    OPS_C_CATCH(handle);
+  }
+
+
+  //! Releases a Lua function.
+  /*! It may be called after its configuration was destroyed.
+    \param[in] function the function. It may be null.
+  */
+  void ops_function_close(ops_function_t* function)
+  {
+    if (function == NULL)
+      return;
+    ops_handle_t* handle = function->handle;
+    if (handle != NULL)
+      {
+        handle->function_list.erase(function);
+        if (function->generation == handle->generation)
+          luaL_unref(handle->GetState(), LUA_REGISTRYINDEX,
+                     function->reference);
+      }
+    delete function;
+  }
+
+
+  //! Writes the Lua definitions of all entries read.
+  /*!
+    \param[in] handle the configuration.
+    \param[in] path path to the output file.
+    \param[in] path_length length of \a path.
+    \return The status code.
+  */
+  int ops_write_lua_definition(ops_handle_t* handle, const char* path,
+                               size_t path_length)
+  {
+    OPS_C_TRY(handle);
+    std::ofstream f(std::string(path, path_length).c_str());
+    f << handle->LuaDefinition();
+    if (!f.good())
+      return handle->Fail(OPS_ERROR_OTHER, "Failed to write in \""
+                          + std::string(path, path_length) + "\".");
+    return OPS_OK;
+    OPS_C_CATCH(handle);
+  }
+
+
+}
+
+
+#define OPS_FILE_OPS_C_CXX
+#endif
@@ -0,0 +1,120 @@
+/* Copyright (C) 2010, Vivien Mallet
+ *
+ * This file is part of Ops, a library for parsing Lua configuration files.
+ *
+ * Ops is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * Ops is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Ops. If not, see http://www.gnu.org/licenses/.
+ */
+
+
+/* C interface to Ops, for C, Fortran, Julia and other foreign callers.
+ *
+ * The objects are opaque handles. The names are passed as a pointer and a
+ * length (they need not be null-terminated). The arrays and strings are
+ * copied into buffers provided by the caller. No exception crosses this
+ * interface: every function returns a status code (OPS_OK on success), and
+ * the message of the last error is available with 'ops_error_message'.
+ *
+ * A handle must not be used by several threads at the same time, but
+ * distinct handles may be used concurrently. The functions opened on a
+ * handle are invalidated when the handle is destroyed: 'ops_function_call'
+ * then returns OPS_ERROR_ARGUMENT, and 'ops_function_close' must still be
+ * called to release them.
+ */
+
+
+#ifndef OPS_FILE_OPS_C_H
+
+#include <stddef.h>
+
+/* Version of the C interface. It is incremented only when the interface
+   changes in a backward-incompatible way. */
+#define OPS_C_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /* Status codes. */
+  enum
+    {
+      OPS_OK = 0,
+      /* The entry or the function was not found. */
+      OPS_ERROR_NOT_FOUND = 1,
+      /* The entry does not have the requested type. */
+      OPS_ERROR_TYPE = 2,
+      /* The output buffer is too small. The required size is returned. */
+      OPS_ERROR_BUFFER = 3,
+      /* An error occurred in Lua (syntax error, run-time error, ...). */
+      OPS_ERROR_LUA = 4,
+      /* Invalid argument, e.g., a null handle or an outdated function. */
+      OPS_ERROR_ARGUMENT = 5,
+      /* Any other error (input/output, memory, ...). */
+      OPS_ERROR_OTHER = 6
+    };
+
+  /* A configuration. */
+  typedef struct ops_handle_t ops_handle_t;
+  /* A Lua function, looked up once and called repeatedly. */
+  typedef struct ops_function_t ops_function_t;
+
+  int ops_c_api_version(void);
+
+  int ops_create(ops_handle_t** handle);
+  void ops_destroy(ops_handle_t* handle);
+  const char* ops_error_message(const ops_handle_t* handle);
+
+  int ops_open(ops_handle_t* handle, const char* path, size_t path_length);
+  int ops_do_file(ops_handle_t* handle, const char* path,
+                  size_t path_length);
+  int ops_do_string(ops_handle_t* handle, const char* code,
+                    size_t code_length);
+  int ops_set_prefix(ops_handle_t* handle, const char* prefix,
+                     size_t prefix_length);
+
+  int ops_exists(ops_handle_t* handle, const char* name, size_t name_length,
+                 int* exists);
+  int ops_get_bool(ops_handle_t* handle, const char* name,
+                   size_t name_length, int* value);
+  int ops_get_int(ops_handle_t* handle, const char* name, size_t name_length,
+                  int* value);
+  int ops_get_double(ops_handle_t* handle, const char* name,
+                     size_t name_length, double* value);
+  int ops_get_string(ops_handle_t* handle, const char* name,
+                     size_t name_length, char* buffer, size_t capacity,
+                     size_t* length);
+  int ops_get_int_array(ops_handle_t* handle, const char* name,
+                        size_t name_length, int* buffer, size_t capacity,
+                        size_t* size);
+  int ops_get_double_array(ops_handle_t* handle, const char* name,
+                           size_t name_length, double* buffer,
+                           size_t capacity, size_t* size);
+
+  int ops_function_open(ops_handle_t* handle, const char* name,
+                        size_t name_length, ops_function_t** function);
+  int ops_function_call(ops_function_t* function, const double* in,
+                        size_t Nin, double* out, size_t capacity,
+                        size_t* Nout);
+  void ops_function_close(ops_function_t* function);
+
+  int ops_write_lua_definition(ops_handle_t* handle, const char* path,
+                               size_t path_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#define OPS_FILE_OPS_C_H
+#endif